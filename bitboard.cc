@@ -0,0 +1,7 @@
+#include "bitboard.h"
+
+namespace chess {
+
+constexpr BitboardTables kBitboardTables = CreateBitboardTables();
+
+}  // namespace chess
@@ -0,0 +1,325 @@
+#ifndef _BITBOARD_H_
+#define _BITBOARD_H_
+
+// 256-bit square sets for the 14x14 four-player board.
+//
+// Square index is 16 * row + col. Each 64-bit word holds four rows, the two
+// columns past the right edge of a row (14, 15) and rows 14-15 are never set
+// in any mask, and neither are the 3x3 dead corners. That leaves 160 legal
+// squares.
+
+#include <cstdint>
+
+namespace chess {
+
+constexpr int kNumSquares = 256;
+constexpr int kNoSquare = 255;
+
+constexpr int SquareIndex(int row, int col) { return (row << 4) | col; }
+constexpr int SquareRow(int square) { return square >> 4; }
+constexpr int SquareCol(int square) { return square & 15; }
+
+class Bitboard {
+ public:
+  constexpr Bitboard() : bits_{0, 0, 0, 0} { }
+  constexpr Bitboard(uint64_t b0, uint64_t b1, uint64_t b2, uint64_t b3)
+    : bits_{b0, b1, b2, b3} { }
+
+  static constexpr Bitboard FromSquare(int square) {
+    Bitboard bb;
+    bb.Set(square);
+    return bb;
+  }
+
+  constexpr bool Test(int square) const {
+    return (bits_[square >> 6] >> (square & 63)) & 1;
+  }
+  constexpr void Set(int square) {
+    bits_[square >> 6] |= uint64_t(1) << (square & 63);
+  }
+  constexpr void Clear(int square) {
+    bits_[square >> 6] &= ~(uint64_t(1) << (square & 63));
+  }
+
+  constexpr bool Empty() const {
+    return (bits_[0] | bits_[1] | bits_[2] | bits_[3]) == 0;
+  }
+  constexpr bool Any() const { return !Empty(); }
+
+  int PopCount() const {
+    return __builtin_popcountll(bits_[0]) + __builtin_popcountll(bits_[1])
+         + __builtin_popcountll(bits_[2]) + __builtin_popcountll(bits_[3]);
+  }
+
+  // Lowest set square. Must not be called on an empty set.
+  int Lsb() const {
+    for (int i = 0; i < 4; i++) {
+      if (bits_[i]) {
+        return (i << 6) + __builtin_ctzll(bits_[i]);
+      }
+    }
+    return kNoSquare;
+  }
+
+  // Highest set square. Must not be called on an empty set.
+  int Msb() const {
+    for (int i = 3; i >= 0; i--) {
+      if (bits_[i]) {
+        return (i << 6) + 63 - __builtin_clzll(bits_[i]);
+      }
+    }
+    return kNoSquare;
+  }
+
+  // Removes and returns the lowest set square.
+  int PopLsb() {
+    for (int i = 0; i < 4; i++) {
+      if (bits_[i]) {
+        int square = (i << 6) + __builtin_ctzll(bits_[i]);
+        bits_[i] &= bits_[i] - 1;
+        return square;
+      }
+    }
+    return kNoSquare;
+  }
+
+  constexpr Bitboard operator&(const Bitboard& other) const {
+    return Bitboard(bits_[0] & other.bits_[0], bits_[1] & other.bits_[1],
+                    bits_[2] & other.bits_[2], bits_[3] & other.bits_[3]);
+  }
+  constexpr Bitboard operator|(const Bitboard& other) const {
+    return Bitboard(bits_[0] | other.bits_[0], bits_[1] | other.bits_[1],
+                    bits_[2] | other.bits_[2], bits_[3] | other.bits_[3]);
+  }
+  constexpr Bitboard operator^(const Bitboard& other) const {
+    return Bitboard(bits_[0] ^ other.bits_[0], bits_[1] ^ other.bits_[1],
+                    bits_[2] ^ other.bits_[2], bits_[3] ^ other.bits_[3]);
+  }
+  // Note: the complement includes off-board squares. Intersect it with a
+  // board mask (or use AndNot) before iterating.
+  constexpr Bitboard operator~() const {
+    return Bitboard(~bits_[0], ~bits_[1], ~bits_[2], ~bits_[3]);
+  }
+  constexpr Bitboard AndNot(const Bitboard& other) const {
+    return Bitboard(bits_[0] & ~other.bits_[0], bits_[1] & ~other.bits_[1],
+                    bits_[2] & ~other.bits_[2], bits_[3] & ~other.bits_[3]);
+  }
+  constexpr Bitboard& operator&=(const Bitboard& other) {
+    return *this = *this & other;
+  }
+  constexpr Bitboard& operator|=(const Bitboard& other) {
+    return *this = *this | other;
+  }
+  constexpr Bitboard& operator^=(const Bitboard& other) {
+    return *this = *this ^ other;
+  }
+  constexpr bool operator==(const Bitboard& other) const {
+    return bits_[0] == other.bits_[0] && bits_[1] == other.bits_[1]
+        && bits_[2] == other.bits_[2] && bits_[3] == other.bits_[3];
+  }
+  constexpr bool operator!=(const Bitboard& other) const {
+    return !(*this == other);
+  }
+
+  constexpr uint64_t Word(int i) const { return bits_[i]; }
+
+ private:
+  uint64_t bits_[4];
+};
+
+// Ray directions. The first four step towards higher square indices, so the
+// nearest blocker on those rays is the lowest set square; for the last four
+// it is the highest.
+enum Direction : int8_t {
+  EAST = 0,        // (0, +1)
+  SOUTH_WEST = 1,  // (+1, -1)
+  SOUTH = 2,       // (+1, 0)
+  SOUTH_EAST = 3,  // (+1, +1)
+  WEST = 4,        // (0, -1)
+  NORTH_EAST = 5,  // (-1, +1)
+  NORTH = 6,       // (-1, 0)
+  NORTH_WEST = 7,  // (-1, -1)
+  NO_DIRECTION = 8,
+};
+
+constexpr int kNumDirections = 8;
+constexpr int kDirectionRowDelta[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+constexpr int kDirectionColDelta[8] = {1, -1, 0, 1, -1, 1, 0, -1};
+// Square index step per direction (16 * row delta + col delta).
+constexpr int kDirectionStep[8] = {1, 15, 16, 17, -1, -15, -16, -17};
+
+constexpr bool IsPositiveDirection(int dir) { return dir < 4; }
+constexpr bool IsDiagonalDirection(int dir) { return dir & 1; }
+
+constexpr bool IsLegalSquare(int row, int col) {
+  return row >= 0 && row < 14 && col >= 0 && col < 14
+      && !((row < 3 || row > 10) && (col < 3 || col > 10));
+}
+
+constexpr int OppositeDirection(int dir) { return dir ^ 4; }
+
+// Attack and geometry tables for every square, generated at compile time.
+struct BitboardTables {
+  Bitboard legal_squares;
+  Bitboard knight_attacks[kNumSquares];
+  Bitboard king_attacks[kNumSquares];
+  // Squares attacked by a pawn of the given color standing on the square.
+  Bitboard pawn_attacks[4][kNumSquares];
+  // All squares along a direction, excluding the origin. Rays stop at the
+  // edge of the board and at the dead corners.
+  Bitboard rays[kNumDirections][kNumSquares];
+  // Direction of the ray from the first square that contains the second,
+  // or NO_DIRECTION.
+  int8_t directions[kNumSquares][kNumSquares];
+  // Squares reachable in exactly two knight moves, where the intermediate
+  // square only needs to be within the 14x14 bounds (used by the eval).
+  Bitboard knight_two_moves[kNumSquares];
+};
+
+constexpr BitboardTables CreateBitboardTables() {
+  BitboardTables tables{};
+
+  // Pawn capture steps per color (RED, BLUE, YELLOW, GREEN).
+  constexpr int kPawnRowDelta[4][2] = {{-1, -1}, {-1, 1}, {1, 1}, {-1, 1}};
+  constexpr int kPawnColDelta[4][2] = {{-1, 1}, {1, 1}, {-1, 1}, {-1, -1}};
+  constexpr int kKnightRowDelta[8] = {-2, -2, -1, -1, 1, 1, 2, 2};
+  constexpr int kKnightColDelta[8] = {-1, 1, -2, 2, -2, 2, -1, 1};
+
+  auto in_bounds = [](int row, int col) {
+    return row >= 0 && row < 14 && col >= 0 && col < 14;
+  };
+
+  for (int from = 0; from < kNumSquares; from++) {
+    for (int to = 0; to < kNumSquares; to++) {
+      tables.directions[from][to] = NO_DIRECTION;
+    }
+  }
+
+  for (int row = 0; row < 14; row++) {
+    for (int col = 0; col < 14; col++) {
+      int square = SquareIndex(row, col);
+
+      for (int i = 0; i < 8; i++) {
+        int r1 = row + kKnightRowDelta[i];
+        int c1 = col + kKnightColDelta[i];
+        if (!in_bounds(r1, c1)) {
+          continue;
+        }
+        for (int j = 0; j < 8; j++) {
+          int r2 = r1 + kKnightRowDelta[j];
+          int c2 = c1 + kKnightColDelta[j];
+          if (in_bounds(r2, c2)) {
+            tables.knight_two_moves[square].Set(SquareIndex(r2, c2));
+          }
+        }
+      }
+
+      if (!IsLegalSquare(row, col)) {
+        continue;
+      }
+      tables.legal_squares.Set(square);
+
+      for (int i = 0; i < 8; i++) {
+        int r = row + kKnightRowDelta[i];
+        int c = col + kKnightColDelta[i];
+        if (IsLegalSquare(r, c)) {
+          tables.knight_attacks[square].Set(SquareIndex(r, c));
+        }
+      }
+
+      for (int color = 0; color < 4; color++) {
+        for (int i = 0; i < 2; i++) {
+          int r = row + kPawnRowDelta[color][i];
+          int c = col + kPawnColDelta[color][i];
+          if (IsLegalSquare(r, c)) {
+            tables.pawn_attacks[color][square].Set(SquareIndex(r, c));
+          }
+        }
+      }
+
+      for (int dir = 0; dir < kNumDirections; dir++) {
+        int r = row + kDirectionRowDelta[dir];
+        int c = col + kDirectionColDelta[dir];
+        if (IsLegalSquare(r, c)) {
+          tables.king_attacks[square].Set(SquareIndex(r, c));
+        }
+        while (IsLegalSquare(r, c)) {
+          tables.rays[dir][square].Set(SquareIndex(r, c));
+          tables.directions[square][SquareIndex(r, c)] = dir;
+          r += kDirectionRowDelta[dir];
+          c += kDirectionColDelta[dir];
+        }
+      }
+    }
+  }
+
+  return tables;
+}
+
+// Defined in bitboard.cc as a constexpr object, so the tables are built by
+// the compiler once and live in read-only data.
+extern const BitboardTables kBitboardTables;
+
+inline const Bitboard& LegalSquares() {
+  return kBitboardTables.legal_squares;
+}
+inline const Bitboard& KnightMask(int square) {
+  return kBitboardTables.knight_attacks[square];
+}
+inline const Bitboard& KingMask(int square) {
+  return kBitboardTables.king_attacks[square];
+}
+inline const Bitboard& PawnAttackMask(int color, int square) {
+  return kBitboardTables.pawn_attacks[color][square];
+}
+inline const Bitboard& RayMask(int dir, int square) {
+  return kBitboardTables.rays[dir][square];
+}
+inline int GetDirection(int from, int to) {
+  return kBitboardTables.directions[from][to];
+}
+inline const Bitboard& KnightTwoMovesMask(int square) {
+  return kBitboardTables.knight_two_moves[square];
+}
+
+// Squares strictly between two squares on a common ray, else empty.
+inline Bitboard BetweenMask(int from, int to) {
+  int dir = GetDirection(from, to);
+  if (dir == NO_DIRECTION) {
+    return Bitboard();
+  }
+  return RayMask(dir, from) & RayMask(OppositeDirection(dir), to);
+}
+
+// Squares reached along a ray up to and including the first occupied square.
+inline Bitboard RayAttackMask(int dir, int square, const Bitboard& occupied) {
+  Bitboard attacks = RayMask(dir, square);
+  Bitboard blockers = attacks & occupied;
+  if (blockers.Any()) {
+    int blocker = IsPositiveDirection(dir) ? blockers.Lsb() : blockers.Msb();
+    attacks ^= RayMask(dir, blocker);
+  }
+  return attacks;
+}
+
+inline Bitboard RookAttackMask(int square, const Bitboard& occupied) {
+  return RayAttackMask(EAST, square, occupied)
+       | RayAttackMask(SOUTH, square, occupied)
+       | RayAttackMask(WEST, square, occupied)
+       | RayAttackMask(NORTH, square, occupied);
+}
+
+inline Bitboard BishopAttackMask(int square, const Bitboard& occupied) {
+  return RayAttackMask(SOUTH_WEST, square, occupied)
+       | RayAttackMask(SOUTH_EAST, square, occupied)
+       | RayAttackMask(NORTH_EAST, square, occupied)
+       | RayAttackMask(NORTH_WEST, square, occupied);
+}
+
+inline Bitboard QueenAttackMask(int square, const Bitboard& occupied) {
+  return RookAttackMask(square, occupied) | BishopAttackMask(square, occupied);
+}
+
+}  // namespace chess
+
+#endif  // _BITBOARD_H_
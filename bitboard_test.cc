@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "gmock/gmock.h"
+
+#include "bitboard.h"
+
+namespace chess {
+namespace {
+
+TEST(BitboardTest, SetClearAndIterate) {
+  Bitboard bb;
+  EXPECT_TRUE(bb.Empty());
+  bb.Set(SquareIndex(0, 3));
+  bb.Set(SquareIndex(7, 7));
+  bb.Set(SquareIndex(13, 10));
+  EXPECT_EQ(bb.PopCount(), 3);
+  EXPECT_TRUE(bb.Test(SquareIndex(7, 7)));
+  EXPECT_EQ(bb.Lsb(), SquareIndex(0, 3));
+  EXPECT_EQ(bb.Msb(), SquareIndex(13, 10));
+
+  bb.Clear(SquareIndex(7, 7));
+  EXPECT_FALSE(bb.Test(SquareIndex(7, 7)));
+  EXPECT_EQ(bb.PopLsb(), SquareIndex(0, 3));
+  EXPECT_EQ(bb.PopLsb(), SquareIndex(13, 10));
+  EXPECT_TRUE(bb.Empty());
+}
+
+TEST(BitboardTest, LegalSquares) {
+  EXPECT_EQ(LegalSquares().PopCount(), 160);
+  EXPECT_FALSE(LegalSquares().Test(SquareIndex(0, 0)));
+  EXPECT_FALSE(LegalSquares().Test(SquareIndex(2, 12)));
+  EXPECT_FALSE(LegalSquares().Test(SquareIndex(0, 14)));
+  EXPECT_TRUE(LegalSquares().Test(SquareIndex(3, 0)));
+  EXPECT_TRUE(LegalSquares().Test(SquareIndex(13, 10)));
+}
+
+TEST(BitboardTest, LeaperMasks) {
+  EXPECT_EQ(KnightMask(SquareIndex(7, 7)).PopCount(), 8);
+  // Next to a dead corner
+  EXPECT_EQ(KnightMask(SquareIndex(3, 0)).PopCount(), 2);
+  EXPECT_EQ(KingMask(SquareIndex(7, 7)).PopCount(), 8);
+  EXPECT_EQ(KingMask(SquareIndex(3, 0)).PopCount(), 3);
+
+  Bitboard red_pawn = PawnAttackMask(0, SquareIndex(12, 5));
+  EXPECT_EQ(red_pawn.PopCount(), 2);
+  EXPECT_TRUE(red_pawn.Test(SquareIndex(11, 4)));
+  EXPECT_TRUE(red_pawn.Test(SquareIndex(11, 6)));
+  Bitboard blue_pawn = PawnAttackMask(1, SquareIndex(5, 1));
+  EXPECT_TRUE(blue_pawn.Test(SquareIndex(4, 2)));
+  EXPECT_TRUE(blue_pawn.Test(SquareIndex(6, 2)));
+}
+
+TEST(BitboardTest, SliderMasks) {
+  // Rays stop at the dead corners.
+  EXPECT_EQ(RayMask(NORTH_EAST, SquareIndex(3, 0)).PopCount(), 0);
+  EXPECT_EQ(RayMask(EAST, SquareIndex(3, 0)).PopCount(), 13);
+
+  Bitboard occupied;
+  EXPECT_EQ(RookAttackMask(SquareIndex(7, 7), occupied).PopCount(), 26);
+
+  occupied.Set(SquareIndex(7, 9));
+  occupied.Set(SquareIndex(4, 7));
+  Bitboard attacks = RookAttackMask(SquareIndex(7, 7), occupied);
+  EXPECT_TRUE(attacks.Test(SquareIndex(7, 9)));
+  EXPECT_FALSE(attacks.Test(SquareIndex(7, 10)));
+  EXPECT_TRUE(attacks.Test(SquareIndex(4, 7)));
+  EXPECT_FALSE(attacks.Test(SquareIndex(3, 7)));
+  EXPECT_EQ(attacks.PopCount(), 2 + 3 + 7 + 6);
+}
+
+TEST(BitboardTest, DirectionsAndBetween) {
+  EXPECT_EQ(GetDirection(SquareIndex(7, 7), SquareIndex(7, 12)), EAST);
+  EXPECT_EQ(GetDirection(SquareIndex(7, 7), SquareIndex(4, 10)), NORTH_EAST);
+  EXPECT_EQ(GetDirection(SquareIndex(7, 7), SquareIndex(8, 9)), NO_DIRECTION);
+  // The diagonal through a dead corner is not a ray.
+  EXPECT_EQ(GetDirection(SquareIndex(3, 0), SquareIndex(0, 3)), NO_DIRECTION);
+
+  Bitboard between = BetweenMask(SquareIndex(7, 7), SquareIndex(4, 10));
+  EXPECT_EQ(between.PopCount(), 2);
+  EXPECT_TRUE(between.Test(SquareIndex(6, 8)));
+  EXPECT_TRUE(between.Test(SquareIndex(5, 9)));
+  EXPECT_EQ(between, BetweenMask(SquareIndex(4, 10), SquareIndex(7, 7)));
+  EXPECT_TRUE(BetweenMask(SquareIndex(7, 7), SquareIndex(7, 8)).Empty());
+}
+
+TEST(BitboardTest, KnightTwoMoves) {
+  Bitboard two_moves = KnightTwoMovesMask(SquareIndex(7, 7));
+  EXPECT_TRUE(two_moves.Test(SquareIndex(7, 7)));
+  EXPECT_TRUE(two_moves.Test(SquareIndex(11, 9)));
+  EXPECT_TRUE(two_moves.Test(SquareIndex(7, 9)));
+  EXPECT_FALSE(two_moves.Test(SquareIndex(8, 9)));
+}
+
+}  // namespace
+}  // namespace chess
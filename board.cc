@@ -16,6 +16,7 @@ namespace chess {
 
 constexpr int kMobilityMultiplier = 5;
 Piece Piece::kNoPiece = Piece();
+Piece Piece::kOffBoard = Piece(true, RED, static_cast<PieceType>(7));
 BoardLocation BoardLocation::kNoLocation = BoardLocation();
 CastlingRights CastlingRights::kMissingRights = CastlingRights();
 
@@ -63,45 +64,56 @@ const Piece kGreenKing(kGreenPlayer, KING);
 
 namespace {
 
-int64_t rand64() {
-  int32_t t0 = rand();
-  int32_t t1 = rand();
-  return (((int64_t)t0) << 32) + (int64_t)t1;
+constexpr uint64_t SplitMix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
 }
 
+constexpr ZobristKeys CreateZobristKeys() {
+  ZobristKeys keys{};
+  uint64_t state = kZobristSeed;
+  for (int color = 0; color < 4; color++) {
+    keys.turns[color] = static_cast<int64_t>(SplitMix64(state));
+  }
+  for (int color = 0; color < 4; color++) {
+    for (int piece_type = 0; piece_type < 6; piece_type++) {
+      for (int square = 0; square < kNumSquares; square++) {
+        keys.pieces[color][piece_type][square] =
+          static_cast<int64_t>(SplitMix64(state));
+      }
+    }
+  }
+  for (int color = 0; color < 4; color++) {
+    for (int castling_type = 0; castling_type < 2; castling_type++) {
+      keys.castling[color][castling_type] =
+        static_cast<int64_t>(SplitMix64(state));
+    }
+  }
+  for (int square = 0; square < kNumSquares; square++) {
+    keys.enpassant[square] = static_cast<int64_t>(SplitMix64(state));
+  }
+  return keys;
+}
+
+// Forward step of the pawns of each color.
+constexpr int kPawnForward[4] = {
+  ColorGeometry<RED>::kForward, ColorGeometry<BLUE>::kForward,
+  ColorGeometry<YELLOW>::kForward, ColorGeometry<GREEN>::kForward,
+};
 
-void AddPawnMoves2(
+
+template <PlayerColor kColor>
+void AddPawnMoves(
     MoveBuffer& moves,
     const BoardLocation& from,
     const BoardLocation& to,
-    const PlayerColor color,
     const Piece capture = Piece::kNoPiece,
     const BoardLocation en_passant_location = BoardLocation::kNoLocation,
     const Piece en_passant_capture = Piece::kNoPiece) {
-  bool is_promotion = false;
-
-  constexpr int kRedPromotionRow = 3;
-  constexpr int kYellowPromotionRow = 10;
-  constexpr int kBluePromotionCol = 10;
-  constexpr int kGreenPromotionCol = 3;
-
-  switch (color) {
-  case RED:
-    is_promotion = to.GetRow() == kRedPromotionRow;
-    break;
-  case BLUE:
-    is_promotion = to.GetCol() == kBluePromotionCol;
-    break;
-  case YELLOW:
-    is_promotion = to.GetRow() == kYellowPromotionRow;
-    break;
-  case GREEN:
-    is_promotion = to.GetCol() == kGreenPromotionCol;
-    break;
-  default:
-    assert(false);
-    break;
-  }
+  bool is_promotion =
+    ColorGeometry<kColor>::Line(to) == ColorGeometry<kColor>::kPromotionLine;
 
   if (is_promotion) {
     moves.emplace_back(from, to, capture, en_passant_location, en_passant_capture, KNIGHT);
@@ -115,211 +127,143 @@ void AddPawnMoves2(
 
 }  // namespace
 
+constexpr ZobristKeys kZobristKeys = CreateZobristKeys();
+
+template <PlayerColor kColor>
+void Board::GetPawnMoves(
+    MoveBuffer& moves,
+    const BoardLocation& from) const {
+  using Geometry = ColorGeometry<kColor>;
+  constexpr Team kTeam = Geometry::kTeam;
+  constexpr int kForward = Geometry::kForward;
+
+  BoardLocation to = from.Offset(kForward);
+  Piece other_piece = GetPiece(to);
+  if (other_piece.Missing()) {
+    // Advance once square
+    AddPawnMoves<kColor>(moves, from, to);
+    // Initial move (advance 2 squares)
+    if (Geometry::Line(from) == Geometry::kPawnStartLine) {
+      to = to.Offset(kForward);
+      other_piece = GetPiece(to);
+      if (other_piece.Missing()) {
+        AddPawnMoves<kColor>(moves, from, to);
+      }
+    }
+  } else if (!other_piece.OffBoard()) {
+
+    // En-passant
+    if (other_piece.GetPieceType() == PAWN
+        && kTeam != other_piece.GetTeam()) {
+
+      int n_turns = (4 + kColor - other_piece.GetColor()) % 4;
+      const Move* other_player_move = nullptr;
+      if (n_turns > 0 && n_turns <= (int)moves_.size()) {
+        other_player_move = &moves_[moves_.size() - n_turns];
+      } else if (n_turns < 4) {
+        const auto& enp_move = enp_.enp_moves[other_piece.GetColor()];
+        if (enp_move.has_value()) {
+          other_player_move = &*enp_move;
+        }
+      }
+
+      if (other_player_move != nullptr
+          && other_player_move->To() == to
+          // TODO: Refactor this with 'enp' locations
+          && other_player_move->ManhattanDistance() == 2
+          && (other_player_move->From().GetRow() == other_player_move->To().GetRow()
+             || other_player_move->From().GetCol() == other_player_move->To().GetCol())
+          ) {
+        const BoardLocation& moved_from = other_player_move->From();
+        int delta_row = to.GetRow() - moved_from.GetRow();
+        int delta_col = to.GetCol() - moved_from.GetCol();
+        BoardLocation enpassant_to = moved_from.Relative(
+            delta_row / 2, delta_col / 2);
+        // there may be both en-passant and piece capture in the same move
+        auto existing = GetPiece(enpassant_to);
+        if (existing.Missing()
+            || existing.GetTeam() != kTeam) {
+          AddPawnMoves<kColor>(moves, from, enpassant_to,
+                               existing, to, other_piece);
+        }
+      }
+
+    }
+
+  }
+
+  // Non-enpassant capture: one step sideways from the forward square
+  for (int sideways : {-Geometry::kSideways, Geometry::kSideways}) {
+    BoardLocation capture_loc = from.Offset(kForward + sideways);
+    const auto& capture = GetPiece(capture_loc);
+    if (capture.Present()
+        && !capture.OffBoard()
+        && capture.GetTeam() != kTeam) {
+      AddPawnMoves<kColor>(moves, from, capture_loc, capture);
+    }
+  }
+}
+
 void Board::GetPawnMoves2(
     MoveBuffer& moves,
     const BoardLocation& from,
     const Piece& piece) const {
-  PlayerColor color = piece.GetColor();
-  Team team = piece.GetTeam();
-
-  // Move forward
-  int delta_rows = 0;
-  int delta_cols = 0;
-  bool not_moved = false;
-  switch (color) {
+  switch (piece.GetColor()) {
   case RED:
-    delta_rows = -1;
-    not_moved = from.GetRow() == 12;
+    GetPawnMoves<RED>(moves, from);
     break;
   case BLUE:
-    delta_cols = 1;
-    not_moved = from.GetCol() == 1;
+    GetPawnMoves<BLUE>(moves, from);
     break;
   case YELLOW:
-    delta_rows = 1;
-    not_moved = from.GetRow() == 1;
+    GetPawnMoves<YELLOW>(moves, from);
     break;
   case GREEN:
-    delta_cols = -1;
-    not_moved = from.GetCol() == 12;
+    GetPawnMoves<GREEN>(moves, from);
     break;
   default:
     assert(false);
     break;
   }
-
-  BoardLocation to = from.Relative(delta_rows, delta_cols);
-  if (IsLegalLocation(to)) {
-    Piece other_piece = GetPiece(to);
-    if (other_piece.Missing()) {
-      // Advance once square
-      AddPawnMoves2(moves, from, to, piece.GetColor());
-      // Initial move (advance 2 squares)
-      if (not_moved) {
-        to = from.Relative(delta_rows * 2, delta_cols * 2);
-        other_piece = GetPiece(to);
-        if (other_piece.Missing()) {
-          AddPawnMoves2(moves, from, to, piece.GetColor());
-        }
-      }
-    } else {
-
-      // En-passant
-      if (other_piece.GetPieceType() == PAWN
-          && piece.GetTeam() != other_piece.GetTeam()) {
-
-        int n_turns = (4 + piece.GetColor() - other_piece.GetColor()) % 4;
-        const Move* other_player_move = nullptr;
-        if (n_turns > 0 && n_turns <= (int)moves_.size()) {
-          other_player_move = &moves_[moves_.size() - n_turns];
-        } else if (n_turns < 4) {
-          const auto& enp_move = enp_.enp_moves[other_piece.GetColor()];
-          if (enp_move.has_value()) {
-            other_player_move = &*enp_move;
-          }
-        }
-
-        if (other_player_move != nullptr
-            && other_player_move->To() == to
-            // TODO: Refactor this with 'enp' locations
-            && other_player_move->ManhattanDistance() == 2
-            && (other_player_move->From().GetRow() == other_player_move->To().GetRow()
-               || other_player_move->From().GetCol() == other_player_move->To().GetCol())
-            ) {
-          const BoardLocation& moved_from = other_player_move->From();
-          int delta_row = to.GetRow() - moved_from.GetRow();
-          int delta_col = to.GetCol() - moved_from.GetCol();
-          BoardLocation enpassant_to = moved_from.Relative(
-              delta_row / 2, delta_col / 2);
-          // there may be both en-passant and piece capture in the same move
-          auto existing = GetPiece(enpassant_to);
-          if (existing.Missing()
-              || existing.GetTeam() != piece.GetTeam()) {
-            AddPawnMoves2(moves, from, enpassant_to, piece.GetColor(),
-                         existing, to, other_piece);
-          }
-        }
-
-      }
-
-    }
-  }
-
-  // Non-enpassant capture
-  bool check_cols = team == RED_YELLOW;
-  int capture_row, capture_col;
-  for (int incr = 0; incr < 2; ++incr) {
-    capture_row = from.GetRow() + delta_rows;
-    capture_col = from.GetCol() + delta_cols;
-    if (check_cols) {
-      capture_col += incr == 0 ? -1 : 1;
-    } else {
-      capture_row += incr == 0 ? -1 : 1;
-    }
-    if (IsLegalLocation(capture_row, capture_col)) {
-      auto other_piece = GetPiece(capture_row, capture_col);
-      if (other_piece.Present()
-          && other_piece.GetTeam() != team) {
-        AddPawnMoves2(moves, from, BoardLocation(capture_row, capture_col),
-            piece.GetColor(), other_piece);
-      }
-    }
-  }
 }
 
 void Board::GetKnightMoves2(
     MoveBuffer& moves,
     const BoardLocation& from,
-    const Piece& piece) const {
-
-  int delta_row, delta_col;
-  for (int pos_row_sign = 0; pos_row_sign < 2; ++pos_row_sign) {
-    for (int abs_delta_row = 1; abs_delta_row < 3; ++abs_delta_row) {
-      delta_row = pos_row_sign > 0 ? abs_delta_row : -abs_delta_row;
-      for (int pos_col_sign = 0; pos_col_sign < 2; ++pos_col_sign) {
-        int abs_delta_col = abs_delta_row == 1 ? 2 : 1;
-        delta_col = pos_col_sign > 0 ? abs_delta_col : -abs_delta_col;
-        BoardLocation to = from.Relative(delta_row, delta_col);
-        if (IsLegalLocation(to)) {
-          const auto capture = GetPiece(to);
-          if (capture.Missing()
-              || capture.GetTeam() != piece.GetTeam()) {
-            moves.emplace_back(from, to, capture);
-          }
-        }
-      }
-    }
-  }
-
-}
-
-void Board::AddMovesFromIncrMovement(
-    std::vector<Move>& moves,
     const Piece& piece,
-    const BoardLocation& from,
-    int incr_row,
-    int incr_col,
-    CastlingRights initial_castling_rights,
-    CastlingRights castling_rights) const {
-  BoardLocation to = from.Relative(incr_row, incr_col);
-  while (IsLegalLocation(to)) {
-    const auto capture = GetPiece(to);
-    if (capture.Missing()) {
-      moves.emplace_back(from, to, Piece::kNoPiece, initial_castling_rights,
-          castling_rights);
-    } else {
-      if (capture.GetTeam() != piece.GetTeam()) {
-        moves.emplace_back(from, to, capture, initial_castling_rights,
-            castling_rights);
-      }
-      break;
-    }
-    to = to.Relative(incr_row, incr_col);
-  }
+    const Bitboard& allowed) const {
+  AddMovesToTargets2(moves, from, (KnightMask(from.Square()) & allowed)
+      .AndNot(GetTeamBitboard(piece.GetTeam())));
 }
 
-void Board::AddMovesFromIncrMovement2(
+void Board::AddMovesToTargets2(
     MoveBuffer& moves,
-    const Piece& piece,
     const BoardLocation& from,
-    int incr_row,
-    int incr_col,
+    Bitboard targets,
     CastlingRights initial_castling_rights,
     CastlingRights castling_rights) const {
-  BoardLocation to = from.Relative(incr_row, incr_col);
-  while (IsLegalLocation(to)) {
-    const auto capture = GetPiece(to);
-    if (capture.Missing()) {
-      moves.emplace_back(from, to, Piece::kNoPiece, initial_castling_rights,
-          castling_rights);
-    } else {
-      if (capture.GetTeam() != piece.GetTeam()) {
-        moves.emplace_back(from, to, capture, initial_castling_rights,
-            castling_rights);
-      }
-      break;
-    }
-    to = to.Relative(incr_row, incr_col);
+  while (targets.Any()) {
+    BoardLocation to = BoardLocation::FromSquare(targets.PopLsb());
+    moves.emplace_back(from, to, GetPiece(to), initial_castling_rights,
+        castling_rights);
   }
 }
 
 void Board::GetBishopMoves2(
     MoveBuffer& moves,
     const BoardLocation& from,
-    const Piece& piece) const {
-
-  for (int pos_row = 0; pos_row < 2; ++pos_row) {
-    for (int pos_col = 0; pos_col < 2; ++pos_col) {
-      AddMovesFromIncrMovement2(
-          moves, piece, from, pos_row ? 1 : -1, pos_col ? 1 : -1);
-    }
-  }
+    const Piece& piece,
+    const Bitboard& allowed) const {
+  AddMovesToTargets2(moves, from,
+      (BishopAttackMask(from.Square(), occupied_bb_) & allowed).AndNot(
+        GetTeamBitboard(piece.GetTeam())));
 }
 
 void Board::GetRookMoves2(
     MoveBuffer& moves,
     const BoardLocation& from,
-    const Piece& piece) const {
+    const Piece& piece,
+    const Bitboard& allowed) const {
 
   // Update castling rights
   CastlingRights initial_castling_rights;
@@ -343,140 +287,59 @@ void Board::GetRookMoves2(
     }
   }
 
-  for (int do_pos_incr = 0; do_pos_incr < 2; ++do_pos_incr) {
-    int incr = do_pos_incr > 0 ? 1 : -1;
-    for (int do_incr_row = 0; do_incr_row < 2; ++do_incr_row) {
-      int incr_row = do_incr_row > 0 ? incr : 0;
-      int incr_col = do_incr_row > 0 ? 0 : incr;
-      AddMovesFromIncrMovement2(moves, piece, from, incr_row, incr_col,
-          initial_castling_rights, castling_rights);
-    }
-  }
+  AddMovesToTargets2(moves, from,
+      (RookAttackMask(from.Square(), occupied_bb_) & allowed).AndNot(
+        GetTeamBitboard(piece.GetTeam())),
+      initial_castling_rights, castling_rights);
 }
 
 void Board::GetQueenMoves2(
     MoveBuffer& moves,
     const BoardLocation& from,
-    const Piece& piece) const {
-  GetBishopMoves2(moves, from, piece);
-  GetRookMoves2(moves, from, piece);
+    const Piece& piece,
+    const Bitboard& allowed) const {
+  GetBishopMoves2(moves, from, piece, allowed);
+  GetRookMoves2(moves, from, piece, allowed);
 }
 
-void Board::GetKingMoves2(
+template <PlayerColor kColor>
+void Board::GetKingMoves(
     MoveBuffer& moves,
-    const BoardLocation& from,
-    const Piece& piece) const {
+    const BoardLocation& from) const {
+  constexpr Team kTeam = ColorGeometry<kColor>::kTeam;
 
-  const CastlingRights& initial_castling_rights = castling_rights_[piece.GetColor()];
+  const CastlingRights& initial_castling_rights = castling_rights_[kColor];
   CastlingRights castling_rights(false, false);
 
-  for (int delta_row = -1; delta_row < 2; ++delta_row) {
-    for (int delta_col = -1; delta_col < 2; ++delta_col) {
-      if (delta_row == 0 && delta_col == 0) {
-        continue;
-      }
-      BoardLocation to = from.Relative(delta_row, delta_col);
-      if (IsLegalLocation(to)) {
-        const auto capture = GetPiece(to);
-        if (capture.Missing()
-            || capture.GetTeam() != piece.GetTeam()) {
-          moves.emplace_back(from, to, capture, initial_castling_rights,
-              castling_rights);
-        }
-      }
-    }
-  }
+  AddMovesToTargets2(moves, from,
+      KingMask(from.Square()).AndNot(GetTeamBitboard(kTeam)),
+      initial_castling_rights, castling_rights);
 
-  Team other_team = OtherTeam(piece.GetTeam());
+  constexpr Team other_team =
+    kTeam == RED_YELLOW ? BLUE_GREEN : RED_YELLOW;
   for (int is_kingside = 0; is_kingside < 2; ++is_kingside) {
     bool allowed = is_kingside ? initial_castling_rights.Kingside() :
       initial_castling_rights.Queenside();
     if (allowed) {
-      std::vector<BoardLocation> squares_between;
-      BoardLocation rook_location;
-
-      switch (piece.GetColor()) {
-      case RED:
-        if (is_kingside) {
-          squares_between = {
-            from.Relative(0, 1),
-            from.Relative(0, 2),
-          };
-          rook_location = from.Relative(0, 3);
-        } else {
-          squares_between = {
-            from.Relative(0, -1),
-            from.Relative(0, -2),
-            from.Relative(0, -3),
-          };
-          rook_location = from.Relative(0, -4);
-        }
-        break;
-      case BLUE:
-        if (is_kingside) {
-          squares_between = {
-            from.Relative(1, 0),
-            from.Relative(2, 0),
-          };
-          rook_location = from.Relative(3, 0);
-        } else {
-          squares_between = {
-            from.Relative(-1, 0),
-            from.Relative(-2, 0),
-            from.Relative(-3, 0),
-          };
-          rook_location = from.Relative(-4, 0);
-        }
-        break;
-      case YELLOW:
-        if (is_kingside) {
-          squares_between = {
-            from.Relative(0, -1),
-            from.Relative(0, -2),
-          };
-          rook_location = from.Relative(0, -3);
-        } else {
-          squares_between = {
-            from.Relative(0, 1),
-            from.Relative(0, 2),
-            from.Relative(0, 3),
-          };
-          rook_location = from.Relative(0, 4);
-        }
-        break;
-      case GREEN:
-        if (is_kingside) {
-          squares_between = {
-            from.Relative(-1, 0),
-            from.Relative(-2, 0),
-          };
-          rook_location = from.Relative(-3, 0);
-        } else {
-          squares_between = {
-            from.Relative(1, 0),
-            from.Relative(2, 0),
-            from.Relative(3, 0),
-          };
-          rook_location = from.Relative(4, 0);
-        }
-        break;
-      default:
-        assert(false);
-        break;
-      }
+      int step = is_kingside ? ColorGeometry<kColor>::kKingsideStep
+                            : -ColorGeometry<kColor>::kKingsideStep;
+      int num_squares_between = is_kingside ? 2 : 3;
 
       // Make sure the rook is present
-      const auto rook = GetPiece(rook_location);
-      if (rook.Missing()
-          || rook.GetPieceType() != ROOK
-          || rook.GetTeam() != piece.GetTeam()) {
+      const BoardLocation rook_location = from.Offset(
+          step * (num_squares_between + 1));
+      const auto& rook = GetPiece(rook_location);
+      if (rook.GetPieceType() != ROOK
+          || rook.OffBoard()
+          || rook.GetTeam() != kTeam) {
         continue;
       }
 
-      // Make sure that there are no pieces between the king and rook
+      // Make sure that there are no pieces between the king and rook.
+      // Padding squares hold the sentinel, so they also block.
       bool piece_between = false;
-      for (const auto& loc : squares_between) {
-        if (GetPiece(loc).Present()) {
+      for (int i = 1; i <= num_squares_between; ++i) {
+        if (GetPiece(from.Offset(step * i)).Present()) {
           piece_between = true;
           break;
         }
@@ -484,11 +347,12 @@ void Board::GetKingMoves2(
 
       if (!piece_between) {
         // Make sure the king is not currently in or would pass through check
-        if (!IsAttackedByTeam(other_team, squares_between[0])
+        const BoardLocation king_passes = from.Offset(step);
+        if (!IsAttackedByTeam(other_team, king_passes)
             && !IsAttackedByTeam(other_team, from)) {
           // Additionally move the castle
-          SimpleMove rook_move(rook_location, squares_between[0]);
-          moves.emplace_back(from, squares_between[1], rook_move,
+          SimpleMove rook_move(rook_location, king_passes);
+          moves.emplace_back(from, from.Offset(2 * step), rook_move,
               initial_castling_rights, castling_rights);
         }
       }
@@ -496,76 +360,53 @@ void Board::GetKingMoves2(
   }
 }
 
+void Board::GetKingMoves2(
+    MoveBuffer& moves,
+    const BoardLocation& from,
+    const Piece& piece) const {
+  switch (piece.GetColor()) {
+  case RED:
+    GetKingMoves<RED>(moves, from);
+    break;
+  case BLUE:
+    GetKingMoves<BLUE>(moves, from);
+    break;
+  case YELLOW:
+    GetKingMoves<YELLOW>(moves, from);
+    break;
+  case GREEN:
+    GetKingMoves<GREEN>(moves, from);
+    break;
+  default:
+    assert(false);
+    break;
+  }
+}
+
 bool Board::RookAttacks(
     const BoardLocation& rook_loc,
     const BoardLocation& other_loc) const {
-  if (rook_loc.GetRow() == other_loc.GetRow()) {
-    bool piece_between = false;
-    for (int col = std::min(rook_loc.GetCol(), other_loc.GetCol()) + 1;
-         col < std::max(rook_loc.GetCol(), other_loc.GetCol());
-         ++col) {
-      if (GetPiece(rook_loc.GetRow(), col).Present()) {
-        piece_between = true;
-        break;
-      }
-    }
-    if (!piece_between) {
-      return true;
-    }
-  }
-  if (rook_loc.GetCol() == other_loc.GetCol()) {
-    bool piece_between = false;
-    for (int row = std::min(rook_loc.GetRow(), other_loc.GetRow()) + 1;
-         row < std::max(rook_loc.GetRow(), other_loc.GetRow());
-         ++row) {
-      if (GetPiece(row, rook_loc.GetCol()).Present()) {
-        piece_between = true;
-        break;
-      }
-    }
-    if (!piece_between) {
-      return true;
-    }
+  if (rook_loc == other_loc) {
+    return true;
   }
-  return false;
+  int dir = GetDirection(rook_loc.Square(), other_loc.Square());
+  return dir != NO_DIRECTION
+      && !IsDiagonalDirection(dir)
+      && (BetweenMask(rook_loc.Square(), other_loc.Square())
+          & occupied_bb_).Empty();
 }
 
 bool Board::BishopAttacks(
     const BoardLocation& bishop_loc,
     const BoardLocation& other_loc) const {
-  int delta_row = bishop_loc.GetRow() - other_loc.GetRow();
-  int delta_col = bishop_loc.GetCol() - other_loc.GetCol();
-  if (std::abs(delta_row) == std::abs(delta_col)) {
-    int row;
-    int col;
-    int col_incr;
-    int row_max;
-    if (bishop_loc.GetRow() < other_loc.GetRow()) {
-      row = bishop_loc.GetRow();
-      col = bishop_loc.GetCol();
-      row_max = other_loc.GetRow();
-      col_incr = bishop_loc.GetCol() < other_loc.GetCol() ? 1 : -1;
-    } else {
-      row = other_loc.GetRow();
-      col = other_loc.GetCol();
-      row_max = bishop_loc.GetRow();
-      col_incr = other_loc.GetCol() < bishop_loc.GetCol() ? 1 : -1;
-    }
-    row++;
-    col += col_incr;
-    bool piece_between = false;
-    while (row < row_max) {
-      if (GetPiece(row, col).Present()) {
-        piece_between = true;
-        break;
-      }
-
-      ++row;
-      col += col_incr;
-    }
-    return !piece_between;
+  if (bishop_loc == other_loc) {
+    return true;
   }
-  return false;
+  int dir = GetDirection(bishop_loc.Square(), other_loc.Square());
+  return dir != NO_DIRECTION
+      && IsDiagonalDirection(dir)
+      && (BetweenMask(bishop_loc.Square(), other_loc.Square())
+          & occupied_bb_).Empty();
 }
 
 bool Board::QueenAttacks(
@@ -578,41 +419,21 @@ bool Board::QueenAttacks(
 bool Board::KingAttacks(
     const BoardLocation& king_loc,
     const BoardLocation& other_loc) const {
-  if ((std::abs(king_loc.GetRow() - other_loc.GetRow())
-        + std::abs(king_loc.GetCol() - other_loc.GetCol())) < 2) {
-    return true;
-  }
-  return false;
+  return KingMask(king_loc.Square()).Test(other_loc.Square());
 }
 
 bool Board::KnightAttacks(
     const BoardLocation& knight_loc,
     const BoardLocation& other_loc) const {
-  int abs_row_diff = std::abs(knight_loc.GetRow() - other_loc.GetRow());
-  int abs_col_diff = std::abs(knight_loc.GetCol() - other_loc.GetCol());
-  return (abs_row_diff == 1 && abs_col_diff == 2)
-    || (abs_row_diff == 2 && abs_col_diff == 1);
+  return KnightMask(knight_loc.Square()).Test(other_loc.Square());
 }
 
 bool Board::PawnAttacks(
     const BoardLocation& pawn_loc,
     PlayerColor pawn_color,
     const BoardLocation& other_loc) const {
-  int row_diff = other_loc.GetRow() - pawn_loc.GetRow();
-  int col_diff = other_loc.GetCol() - pawn_loc.GetCol();
-  switch (pawn_color) {
-  case RED:
-    return row_diff == -1 && (std::abs(col_diff) == 1);
-  case BLUE:
-    return col_diff == 1 && (std::abs(row_diff) == 1);
-  case YELLOW:
-    return row_diff == 1 && (std::abs(col_diff) == 1);
-  case GREEN:
-    return col_diff == -1 && (std::abs(row_diff) == 1);
-  default:
-    assert(false);
-    return false;
-  }
+  return PawnAttackMask(pawn_color, pawn_loc.Square())
+    .Test(other_loc.Square());
 }
 
 size_t Board::GetAttackers2(
@@ -620,160 +441,294 @@ size_t Board::GetAttackers2(
     Team team, const BoardLocation& location) const {
   assert(limit > 0);
   size_t pos = 0;
+  int square = location.Square();
+  Bitboard team_bb = team == NO_TEAM ? occupied_bb_ : GetTeamBitboard(team);
 
-#define ADD_ATTACKER(row, col, piece) \
-  buffer[pos++] = PlacedPiece(BoardLocation(row, col), piece); \
-  if (pos == limit) { \
-    return limit; \
-  }
-
-  int loc_row = location.GetRow();
-  int loc_col = location.GetCol();
-  bool no_team = team == NO_TEAM;
+  auto add_attackers = [&](Bitboard attackers) {
+    while (attackers.Any() && pos < limit) {
+      BoardLocation loc = BoardLocation::FromSquare(attackers.PopLsb());
+      buffer[pos++] = PlacedPiece(loc, GetPiece(loc));
+    }
+    return pos == limit;
+  };
 
   // Rooks & queens
-  for (int do_incr_row = 0; do_incr_row < 2; ++do_incr_row) {
-    for (int pos_incr = 0; pos_incr < 2; ++pos_incr) {
-      int row_incr = do_incr_row ? (pos_incr ? 1 : -1) : 0;
-      int col_incr = do_incr_row ? 0 : (pos_incr ? 1 : -1);
-      int row = loc_row + row_incr;
-      int col = loc_col + col_incr;
-      while (row >= 0 && row < 14 && col >= 0 && col < 14) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()) {
-          if ((piece.GetTeam() == team || no_team)
-              && (piece.GetPieceType() == ROOK
-                  || piece.GetPieceType() == QUEEN)) {
-            ADD_ATTACKER(row, col, piece);
-          }
-          break;
-        }
-        row += row_incr;
-        col += col_incr;
-      }
-    }
+  Bitboard rooks_queens = (piece_type_bb_[ROOK] | piece_type_bb_[QUEEN])
+    & team_bb;
+  if (rooks_queens.Any()
+      && add_attackers(RookAttackMask(square, occupied_bb_) & rooks_queens)) {
+    return limit;
   }
 
   // Bishops & queens
-  for (int pos_row = 0; pos_row < 2; ++pos_row) {
-    int row_incr = pos_row ? 1 : -1;
-    for (int pos_col = 0; pos_col < 2; ++pos_col) {
-      int col_incr = pos_col ? 1 : -1;
-      int row = loc_row + row_incr;
-      int col = loc_col + col_incr;
-      while (IsLegalLocation(row, col)) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()) {
-          if ((piece.GetTeam() == team || no_team)
-              && (piece.GetPieceType() == BISHOP
-                  || piece.GetPieceType() == QUEEN)) {
-            ADD_ATTACKER(row, col, piece);
-          }
-          break;
-        }
-        row += row_incr;
-        col += col_incr;
-      }
-    }
+  Bitboard bishops_queens = (piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN])
+    & team_bb;
+  if (bishops_queens.Any()
+      && add_attackers(BishopAttackMask(square, occupied_bb_)
+                       & bishops_queens)) {
+    return limit;
   }
 
   // Knights
-  for (int row_less = 0; row_less < 2; ++row_less) {
-    for (int pos_row = 0; pos_row < 2; ++pos_row) {
-      int row = loc_row + (row_less ? (pos_row ? 1 : -1) : (pos_row ? 2: -2));
-      for (int pos_col = 0; pos_col < 2; ++pos_col) {
-        int col = loc_col + (row_less ? (pos_col ? 2: -2): (pos_col ? 1 : -1));
-        if (IsLegalLocation(row, col)) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()
-              && (piece.GetTeam() == team || no_team)
-              && piece.GetPieceType() == KNIGHT) {
-            ADD_ATTACKER(row, col, piece);
-          }
-        }
+  if (add_attackers(KnightMask(square) & piece_type_bb_[KNIGHT] & team_bb)) {
+    return limit;
+  }
+
+  // Pawns: a pawn of a color attacks this square iff a pawn of the opposite
+  // color on this square would attack the pawn's square.
+  Bitboard pawns = piece_type_bb_[PAWN] & team_bb;
+  if (pawns.Any()) {
+    for (int color = 0; color < 4; ++color) {
+      if (add_attackers(PawnAttackMask((color + 2) % 4, square)
+                        & pawns & color_bb_[color])) {
+        return limit;
       }
     }
   }
 
-  // Pawns
-  for (int pos_row = 0; pos_row < 2; ++pos_row) {
-    int row = pos_row ? loc_row + 1 : loc_row - 1;
-    if (row >= 0 && row < 14) {
-      for (int pos_col = 0; pos_col < 2; ++pos_col) {
-        int col = pos_col ? loc_col + 1 : loc_col - 1;
-        if (col >= 0 && col < 14) {
-          const auto piece = GetPiece(row, col);
-          if (piece.Present()
-              && (piece.GetTeam() == team || no_team)
-              && piece.GetPieceType() == PAWN) {
-            bool attacks = false;
-            switch (piece.GetColor()) {
-            case RED:
-              if (pos_row) {
-                attacks = true;
-              }
-              break;
-            case BLUE:
-              if (!pos_col) {
-                attacks = true;
-              }
-              break;
-            case YELLOW:
-              if (!pos_row) {
-                attacks = true;
-              }
-              break;
-            case GREEN:
-              if (pos_col) {
-                attacks = true;
-              }
-              break;
-            default:
-              assert(false);
-              break;
-            }
-
-            if (attacks) {
-              ADD_ATTACKER(row, col, piece);
-            }
-
-          }
-        }
-      }
-    }
+  // Kings
+  add_attackers(KingMask(square) & piece_type_bb_[KING] & team_bb);
+
+  return pos;
+}
+
+Bitboard Board::GetAttackersBitboard(
+    int square, const Bitboard& occupied) const {
+  Bitboard rooks_queens = piece_type_bb_[ROOK] | piece_type_bb_[QUEEN];
+  Bitboard bishops_queens = piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN];
+  Bitboard attackers =
+      (KnightMask(square) & piece_type_bb_[KNIGHT])
+    | (KingMask(square) & piece_type_bb_[KING])
+    | (RookAttackMask(square, occupied) & rooks_queens)
+    | (BishopAttackMask(square, occupied) & bishops_queens);
+  for (int color = 0; color < 4; color++) {
+    attackers |= PawnAttackMask((color + 2) % 4, square)
+      & piece_type_bb_[PAWN] & color_bb_[color];
   }
+  return attackers & occupied;
+}
 
-  // Kings
-  for (int delta_row = -1; delta_row < 2; ++delta_row) {
-    int row = loc_row + delta_row;
-    for (int delta_col = -1; delta_col < 2; ++delta_col) {
-      if (delta_row == 0 && delta_col == 0) {
-        continue;
-      }
-      int col = loc_col + delta_col;
-      if (IsLegalLocation(row, col)) {
-        const auto piece = GetPiece(row, col);
-        if (piece.Present()
-            && (piece.GetTeam() == team || no_team)
-            && piece.GetPieceType() == KING) {
-          ADD_ATTACKER(row, col, piece);
-        }
-      }
+Bitboard Board::GetExchangeOccupancy(const Move& move) const {
+  Bitboard occupied = occupied_bb_;
+  occupied.Clear(move.From().Square());
+  const auto enpassant_location = move.GetEnpassantLocation();
+  if (enpassant_location.Present()) {
+    occupied.Clear(enpassant_location.Square());
+  }
+  return occupied;
+}
+
+int Board::StaticExchangeEvaluation(
+    const Move& move, const int piece_evaluations[6]) const {
+  const int to = move.To().Square();
+  const Piece piece = GetPiece(move.From());
+  PieceType on_square = move.GetPromotionPieceType() != NO_PIECE
+    ? move.GetPromotionPieceType() : piece.GetPieceType();
+  const auto capture = move.GetCapturePiece();
+
+  Bitboard occupied = GetExchangeOccupancy(move);
+  Bitboard attackers = GetAttackersBitboard(to, occupied);
+  const Bitboard bishops_queens =
+    piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN];
+  const Bitboard rooks_queens = piece_type_bb_[ROOK] | piece_type_bb_[QUEEN];
+
+  // gain[d]: material won by the side making capture d if the exchange
+  // stopped after it. Every capture removes a piece, so kNumSquares / 2
+  // entries are more than enough.
+  int gain[kNumSquares / 2];
+  int depth = 0;
+  gain[0] = capture.Present() ? piece_evaluations[capture.GetPieceType()] : 0;
+  int value_on_square = piece_evaluations[on_square];
+  Team side = OtherTeam(piece.GetTeam());
+
+  while (true) {
+    Bitboard side_attackers = attackers & GetTeamBitboard(side);
+    if (side_attackers.Empty()) {
+      break;
+    }
+    int pt = PAWN;
+    while ((side_attackers & piece_type_bb_[pt]).Empty()) {
+      pt++;
     }
+    depth++;
+    gain[depth] = value_on_square - gain[depth - 1];
+    value_on_square = piece_evaluations[pt];
+
+    occupied.Clear((side_attackers & piece_type_bb_[pt]).Lsb());
+    // X-rays behind the captured-from square
+    if (pt == PAWN || pt == BISHOP || pt == QUEEN || pt == KING) {
+      attackers |= BishopAttackMask(to, occupied) & bishops_queens;
+    }
+    if (pt == ROOK || pt == QUEEN || pt == KING) {
+      attackers |= RookAttackMask(to, occupied) & rooks_queens;
+    }
+    attackers &= occupied;
+    side = OtherTeam(side);
   }
 
-#undef ADD_ATTACKER
+  while (depth > 0) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    depth--;
+  }
+  return gain[0];
+}
 
-  return pos;
+bool Board::StaticExchangeEvaluationGe(
+    const Move& move, int threshold, const int piece_evaluations[6]) const {
+  const int to = move.To().Square();
+  const Piece piece = GetPiece(move.From());
+  PieceType on_square = move.GetPromotionPieceType() != NO_PIECE
+    ? move.GetPromotionPieceType() : piece.GetPieceType();
+  const auto capture = move.GetCapturePiece();
+
+  // swap: how far the side to capture next is from deciding the exchange
+  // in its favour.
+  int swap = (capture.Present() ? piece_evaluations[capture.GetPieceType()]
+                                : 0) - threshold;
+  if (swap < 0) {
+    return false;
+  }
+  swap = piece_evaluations[on_square] - swap;
+  if (swap <= 0) {
+    return true;
+  }
+
+  Bitboard occupied = GetExchangeOccupancy(move);
+  Bitboard attackers = GetAttackersBitboard(to, occupied);
+  const Bitboard bishops_queens =
+    piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN];
+  const Bitboard rooks_queens = piece_type_bb_[ROOK] | piece_type_bb_[QUEEN];
+
+  Team side = piece.GetTeam();
+  int result = 1;
+  while (true) {
+    side = OtherTeam(side);
+    attackers &= occupied;
+    Bitboard side_attackers = attackers & GetTeamBitboard(side);
+    if (side_attackers.Empty()) {
+      break;
+    }
+    result ^= 1;
+    int pt = PAWN;
+    while ((side_attackers & piece_type_bb_[pt]).Empty()) {
+      pt++;
+    }
+    swap = piece_evaluations[pt] - swap;
+    if (swap < result) {
+      break;
+    }
+
+    occupied.Clear((side_attackers & piece_type_bb_[pt]).Lsb());
+    if (pt == PAWN || pt == BISHOP || pt == QUEEN || pt == KING) {
+      attackers |= BishopAttackMask(to, occupied) & bishops_queens;
+    }
+    if (pt == ROOK || pt == QUEEN || pt == KING) {
+      attackers |= RookAttackMask(to, occupied) & rooks_queens;
+    }
+  }
+  return result;
 }
 
 bool Board::IsAttackedByTeam(Team team, const BoardLocation& location) const {
-  PlacedPiece attackers[1];
-  size_t pos = GetAttackers2(attackers, 1, team, location);
-  return pos > 0;
+  int square = location.Square();
+  if (team == NO_TEAM) {
+    return (GetAttackedSquares(RED_YELLOW) | GetAttackedSquares(BLUE_GREEN))
+      .Test(square);
+  }
+  return GetAttackedSquares(team).Test(square);
+}
+
+Bitboard Board::GetPieceAttacks(const Piece& piece, int square) const {
+  switch (piece.GetPieceType()) {
+  case PAWN:
+    return PawnAttackMask(piece.GetColor(), square);
+  case KNIGHT:
+    return KnightMask(square);
+  case BISHOP:
+    return BishopAttackMask(square, occupied_bb_);
+  case ROOK:
+    return RookAttackMask(square, occupied_bb_);
+  case QUEEN:
+    return QueenAttackMask(square, occupied_bb_);
+  case KING:
+    return KingMask(square);
+  default:
+    assert(false);
+    return Bitboard();
+  }
+}
+
+template <int kDelta, bool kThroughRays>
+void Board::UpdateAttacksAround(const Piece& piece, int square) {
+  PieceType type = piece.GetPieceType();
+  // Nearest piece in every direction, for the rays of sliders. Rays exclude
+  // the origin, so this does not depend on whether the square is occupied
+  // yet.
+  int nearest[kNumDirections];
+  if (kThroughRays || type == BISHOP || type == ROOK || type == QUEEN) {
+    for (int dir = 0; dir < kNumDirections; dir++) {
+      nearest[dir] = NearestPieceSquare(square, dir);
+    }
+  }
+  // Attacks along a ray from the square, up to and including the nearest
+  // piece.
+  auto ray_attacks = [&](int dir) {
+    Bitboard attacks = RayMask(dir, square);
+    if (nearest[dir] != kNoSquare) {
+      attacks ^= RayMask(dir, nearest[dir]);
+    }
+    return attacks;
+  };
+
+  Bitboard attacks;
+  switch (type) {
+  case PAWN:
+    attacks = PawnAttackMask(piece.GetColor(), square);
+    break;
+  case KNIGHT:
+    attacks = KnightMask(square);
+    break;
+  case KING:
+    attacks = KingMask(square);
+    break;
+  default:
+    for (int dir = 0; dir < kNumDirections; dir++) {
+      if (type == QUEEN || (type == BISHOP) == IsDiagonalDirection(dir)) {
+        attacks |= ray_attacks(dir);
+      }
+    }
+    break;
+  }
+  UpdateAttackCounts(piece.GetTeam(), attacks, kDelta);
+  if (!kThroughRays) {
+    return;
+  }
+
+  // Sliders whose rays run through the square: occupying it cuts their rays
+  // short, vacating it extends them up to the next piece.
+  for (int dir = 0; dir < kNumDirections; dir++) {
+    if (nearest[dir] == kNoSquare) {
+      continue;
+    }
+    const Piece& slider = location_to_piece_[nearest[dir]];
+    PieceType slider_type = slider.GetPieceType();
+    if (slider_type == QUEEN
+        || (slider_type == BISHOP && IsDiagonalDirection(dir))
+        || (slider_type == ROOK && !IsDiagonalDirection(dir))) {
+      UpdateAttackCounts(slider.GetTeam(),
+                         ray_attacks(OppositeDirection(dir)), -kDelta);
+    }
+  }
+}
 
-  // auto attackers = GetAttackers(team, location, /*return_early=*/true);
-  // return attackers.size() > 0;
+void Board::InitializeAttackCounts() {
+  attack_counts_ = AttackCounts();
+  Bitboard pieces = occupied_bb_;
+  while (pieces.Any()) {
+    int square = pieces.PopLsb();
+    const auto& piece = location_to_piece_[square];
+    UpdateAttackCounts(piece.GetTeam(), GetPieceAttacks(piece, square), 1);
+  }
 }
 
 bool Board::IsOnPathBetween(
@@ -792,80 +747,164 @@ bool Board::DiscoversCheck(
     const BoardLocation& move_from,
     const BoardLocation& move_to,
     Team attacking_team) const {
-  int delta_row = move_from.GetRow() - king_location.GetRow();
-  int delta_col = move_from.GetCol() - king_location.GetCol();
-  if (std::abs(delta_row) != std::abs(delta_col)
-      && delta_row != 0
-      && delta_col != 0) {
+  int dir = GetDirection(king_location.Square(), move_from.Square());
+  if (dir == NO_DIRECTION) {
+    return false;
+  }
+
+  // First piece behind the vacated square, seen from the king
+  Bitboard occupied = occupied_bb_;
+  occupied.Clear(move_from.Square());
+  occupied.Set(move_to.Square());
+  Bitboard blockers = RayMask(dir, king_location.Square()) & occupied;
+  if (blockers.Empty()) {
+    return false;
+  }
+  int blocker = IsPositiveDirection(dir) ? blockers.Lsb() : blockers.Msb();
+  if (blocker == move_to.Square()) {
+    return false;
+  }
+  const auto& piece = location_to_piece_[blocker];
+  if (piece.GetTeam() != attacking_team) {
     return false;
   }
+  PieceType slider = IsDiagonalDirection(dir) ? BISHOP : ROOK;
+  return piece.GetPieceType() == QUEEN || piece.GetPieceType() == slider;
+}
+
+void Board::GetPieceMoves2(
+    MoveBuffer& moves,
+    const BoardLocation& from,
+    const Piece& piece) const {
+  switch (piece.GetPieceType()) {
+    case PAWN:
+      GetPawnMoves2(moves, from, piece);
+      break;
+    case KNIGHT:
+      GetKnightMoves2(moves, from, piece);
+      break;
+    case BISHOP:
+      GetBishopMoves2(moves, from, piece);
+      break;
+    case ROOK:
+      GetRookMoves2(moves, from, piece);
+      break;
+    case QUEEN:
+      GetQueenMoves2(moves, from, piece);
+      break;
+    case KING:
+      GetKingMoves2(moves, from, piece);
+      break;
+    default:
+     assert(false);
+  }
+}
+
+size_t Board::GetPseudoLegalMoves2(Move* buffer, size_t limit) {
+  BoardLocation king_location = GetKingLocation(turn_.GetColor());
+  if (!king_location.Present()) {
+    return 0;
+  }
+  return GetMovesToTargets(buffer, limit, ~Bitboard());
+}
+
+std::optional<Move> Board::UnpackMove(const PackedMove& packed) const {
+  if (!packed.Present()) {
+    return std::nullopt;
+  }
+  BoardLocation from = BoardLocation::FromSquare(packed.From());
+  const Piece& piece = GetPiece(from);
+  if (piece.Missing() || piece.OffBoard()
+      || piece.GetColor() != turn_.GetColor()) {
+    return std::nullopt;
+  }
+
+  // A single piece has at most a few dozen moves.
+  constexpr size_t kLimit = 128;
+  Move buffer[kLimit];
+  MoveBuffer move_buffer;
+  move_buffer.buffer = buffer;
+  move_buffer.limit = kLimit;
+  GetPieceMoves2(move_buffer, from, piece);
+  for (size_t i = 0; i < move_buffer.pos; i++) {
+    if (PackedMove(buffer[i]) == packed) {
+      return buffer[i];
+    }
+  }
+  return std::nullopt;
+}
 
-  int incr_col = delta_col == 0 ? 0 : delta_col > 0 ? 1 : -1;
-  int incr_row = delta_row == 0 ? 0 : delta_row > 0 ? 1 : -1;
-  int row = king_location.GetRow() + incr_row;
-  int col = king_location.GetCol() + incr_col;
-  while (IsLegalLocation(row, col)) {
-    if (row != move_from.GetRow() || col != move_from.GetCol()) {
-      if (row == move_to.GetRow() && col == move_to.GetCol()) {
-        return false;
-      }
-      const auto piece = GetPiece(row, col);
-      if (piece.Present()) {
-        if (piece.GetTeam() == attacking_team) {
-          if (delta_row == 0 || delta_col == 0) {
-            if (piece.GetPieceType() == QUEEN
-                || piece.GetPieceType() == ROOK) {
-              return true;
-            }
-          } else {
-            if (piece.GetPieceType() == QUEEN
-                || piece.GetPieceType() == BISHOP) {
-              return true;
-            }
-          }
-        }
-        break;
-      }
+Bitboard Board::GetAttackersBitboard(Team team, int square) const {
+  Bitboard rooks_queens = piece_type_bb_[ROOK] | piece_type_bb_[QUEEN];
+  Bitboard bishops_queens = piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN];
+  Bitboard attackers =
+      (KnightMask(square) & piece_type_bb_[KNIGHT])
+    | (KingMask(square) & piece_type_bb_[KING])
+    | (RookAttackMask(square, occupied_bb_) & rooks_queens)
+    | (BishopAttackMask(square, occupied_bb_) & bishops_queens);
+  for (int color = 0; color < 4; color++) {
+    if (GetTeam(static_cast<PlayerColor>(color)) == team) {
+      attackers |= PawnAttackMask((color + 2) % 4, square)
+        & piece_type_bb_[PAWN] & color_bb_[color];
     }
+  }
+  return attackers & GetTeamBitboard(team);
+}
 
-    row += incr_row;
-    col += incr_col;
+Bitboard Board::GetPinnedPieces(int king_square) const {
+  Team other_team = OtherTeam(turn_.GetTeam());
+  Bitboard pinned;
+  for (int dir = 0; dir < kNumDirections; dir++) {
+    int blocker = NearestPieceSquare(king_square, dir);
+    if (blocker == kNoSquare
+        || location_to_piece_[blocker].GetColor() != turn_.GetColor()) {
+      continue;
+    }
+    int pinner = NearestPieceSquare(blocker, dir);
+    if (pinner == kNoSquare) {
+      continue;
+    }
+    const auto& piece = location_to_piece_[pinner];
+    PieceType slider = IsDiagonalDirection(dir) ? BISHOP : ROOK;
+    if (piece.GetTeam() == other_team
+        && (piece.GetPieceType() == QUEEN
+            || piece.GetPieceType() == slider)) {
+      pinned.Set(blocker);
+    }
   }
-  return false;
+  return pinned;
 }
 
-size_t Board::GetPseudoLegalMoves2(Move* buffer, size_t limit) {
+template <PlayerColor kColor>
+size_t Board::GetMovesToTargets(Move* buffer, size_t limit,
+                                const Bitboard& targets) {
   MoveBuffer move_buffer;
   move_buffer.buffer = buffer;
   move_buffer.limit = limit;
 
-  BoardLocation king_location = GetKingLocation(turn_.GetColor());
-  if (!king_location.Present()) {
-    return 0;
-  }
-
-  for (const auto& placed_piece : piece_list_[turn_.GetColor()]) {
+  for (const auto& placed_piece : piece_list_[kColor]) {
     const auto& location = placed_piece.GetLocation();
     const auto& piece = placed_piece.GetPiece();
     switch (piece.GetPieceType()) {
       case PAWN:
-        GetPawnMoves2(move_buffer, location, piece);
+        // Pawn moves depend on the mailbox (en-passant, double steps), so
+        // they are generated in full and filtered by the caller.
+        GetPawnMoves<kColor>(move_buffer, location);
         break;
       case KNIGHT:
-        GetKnightMoves2(move_buffer, location, piece);
+        GetKnightMoves2(move_buffer, location, piece, targets);
         break;
       case BISHOP:
-        GetBishopMoves2(move_buffer, location, piece);
+        GetBishopMoves2(move_buffer, location, piece, targets);
         break;
       case ROOK:
-        GetRookMoves2(move_buffer, location, piece);
+        GetRookMoves2(move_buffer, location, piece, targets);
         break;
       case QUEEN:
-        GetQueenMoves2(move_buffer, location, piece);
+        GetQueenMoves2(move_buffer, location, piece, targets);
         break;
       case KING:
-        GetKingMoves2(move_buffer, location, piece);
-        king_location = location;
+        GetKingMoves<kColor>(move_buffer, location);
         break;
       default:
        assert(false);
@@ -875,6 +914,146 @@ size_t Board::GetPseudoLegalMoves2(Move* buffer, size_t limit) {
   return move_buffer.pos;
 }
 
+size_t Board::GetMovesToTargets(Move* buffer, size_t limit,
+                                const Bitboard& targets) {
+  switch (turn_.GetColor()) {
+  case RED:
+    return GetMovesToTargets<RED>(buffer, limit, targets);
+  case BLUE:
+    return GetMovesToTargets<BLUE>(buffer, limit, targets);
+  case YELLOW:
+    return GetMovesToTargets<YELLOW>(buffer, limit, targets);
+  case GREEN:
+    return GetMovesToTargets<GREEN>(buffer, limit, targets);
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+bool Board::IsLegalPseudoLegalMove(
+    const Move& move, int king_square, const Bitboard& checkers,
+    const Bitboard& pinned) {
+  const auto standard_capture = move.GetStandardCapture();
+  if (standard_capture.Present() && standard_capture.GetPieceType() == KING) {
+    return true;
+  }
+
+  // En-passant removes a second piece and castling moves two, so these rare
+  // cases are checked by making the move.
+  if (move.GetEnpassantLocation().Present() || move.GetRookMove().Present()) {
+    Player player = turn_;
+    MakeMove(move);
+    bool legal = CheckWasLastMoveKingCapture() != IN_PROGRESS
+      || !IsKingInCheck(player);
+    UndoMove();
+    return legal;
+  }
+
+  int from = move.From().Square();
+  int to = move.To().Square();
+  Team other_team = OtherTeam(turn_.GetTeam());
+
+  if (from == king_square) {
+    if (GetAttackedSquares(other_team).Test(to)) {
+      return false;
+    }
+    // A slider giving check still attacks the squares behind the king once
+    // it has stepped away.
+    Bitboard sliders = checkers.AndNot(
+        piece_type_bb_[PAWN] | piece_type_bb_[KNIGHT] | piece_type_bb_[KING]);
+    while (sliders.Any()) {
+      int slider = sliders.PopLsb();
+      if (GetDirection(slider, to) == GetDirection(slider, king_square)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (checkers.Any()) {
+    if (checkers.PopCount() > 1) {
+      return false;
+    }
+    int checker = checkers.Lsb();
+    if (to != checker && !BetweenMask(king_square, checker).Test(to)) {
+      return false;
+    }
+  }
+
+  return !pinned.Test(from)
+      || GetDirection(king_square, to) == GetDirection(king_square, from);
+}
+
+size_t Board::GetLegalMoves(Move* buffer, size_t limit, MoveGenType type) {
+  BoardLocation king_location = GetKingLocation(turn_.GetColor());
+  if (!king_location.Present()) {
+    return 0;
+  }
+  int king_square = king_location.Square();
+
+  Bitboard checkers;
+  if (IsKingInCheck(turn_)) {
+    checkers = GetAttackersBitboard(
+        OtherTeam(turn_.GetTeam()), king_square);
+  }
+  Bitboard pinned = GetPinnedPieces(king_square);
+
+  Bitboard targets = ~Bitboard();
+  if (type == CAPTURES) {
+    targets = GetTeamBitboard(OtherTeam(turn_.GetTeam()));
+  } else if (type == QUIETS) {
+    targets = ~occupied_bb_;
+  }
+  if (checkers.Any()) {
+    // Other pieces can only help against a single checker, by capturing or
+    // blocking it. Capturing an enemy king is always allowed.
+    Bitboard evasions = piece_type_bb_[KING]
+      & GetTeamBitboard(OtherTeam(turn_.GetTeam()));
+    if (checkers.PopCount() == 1) {
+      evasions |= checkers | BetweenMask(king_square, checkers.Lsb());
+    }
+    targets &= evasions;
+  }
+
+  size_t num_moves = type == ALL_MOVES && checkers.Empty()
+    ? GetPseudoLegalMoves2(buffer, limit)
+    : GetMovesToTargets(buffer, limit, targets);
+
+  // Filter in place, keeping the generation order.
+  size_t num_legal = 0;
+  for (size_t i = 0; i < num_moves; i++) {
+    const Move& move = buffer[i];
+    if (type != ALL_MOVES && move.IsCapture() != (type == CAPTURES)) {
+      continue;
+    }
+    if (IsLegalPseudoLegalMove(move, king_square, checkers, pinned)) {
+      buffer[num_legal++] = move;
+    }
+  }
+  return num_legal;
+}
+
+bool Board::IsLegalMove(const Move& move) {
+  std::optional<Move> generated = UnpackMove(PackedMove(move));
+  if (!generated.has_value() || !(*generated == move)) {
+    return false;
+  }
+  BoardLocation king_location = GetKingLocation(turn_.GetColor());
+  if (!king_location.Present()) {
+    return false;
+  }
+  int king_square = king_location.Square();
+
+  Bitboard checkers;
+  if (IsKingInCheck(turn_)) {
+    checkers = GetAttackersBitboard(
+        OtherTeam(turn_.GetTeam()), king_square);
+  }
+  return IsLegalPseudoLegalMove(move, king_square, checkers,
+                                GetPinnedPieces(king_square));
+}
+
 GameResult Board::GetGameResult() {
   if (!GetKingLocation(turn_.GetColor()).Present()) {
     // other team won
@@ -882,20 +1061,15 @@ GameResult Board::GetGameResult() {
   }
   Player player = turn_;
 
-  size_t num_moves = GetPseudoLegalMoves2(move_buffer_2_, move_buffer_size_);
-  for (size_t i = 0; i < num_moves; i++) {
-    const auto& move = move_buffer_2_[i];
-    MakeMove(move);
-    GameResult king_capture_result = CheckWasLastMoveKingCapture();
-    if (king_capture_result != IN_PROGRESS) {
-      UndoMove();
-      return king_capture_result;
-    }
-    bool legal = !IsKingInCheck(player);
-    UndoMove();
-    if (legal) {
-      return IN_PROGRESS;
+  Move moves[kMaxMovesPerPosition];
+  size_t num_moves = GetLegalMoves(moves, kMaxMovesPerPosition);
+  if (num_moves > 0) {
+    // The first move decides: a king capture ends the game.
+    const auto capture = moves[0].GetCapturePiece();
+    if (capture.Present() && capture.GetPieceType() == KING) {
+      return capture.GetTeam() == RED_YELLOW ? WIN_BG : WIN_RY;
     }
+    return IN_PROGRESS;
   }
   if (!IsKingInCheck(player)) {
     return STALEMATE;
@@ -940,9 +1114,31 @@ GameResult Board::CheckWasLastMoveKingCapture() const {
 void Board::SetPiece(
     const BoardLocation& location,
     const Piece& piece) {
-  location_to_piece_[location.GetRow()][location.GetCol()] = piece;
-  // Add to piece_list_
-  piece_list_[piece.GetColor()].emplace_back(location, piece);
+  PlacePiece<true>(location, piece);
+  AddToPieceList(location, piece);
+}
+
+void Board::RemovePiece(const BoardLocation& location) {
+  RemoveFromPieceList(location, GetPiece(location).GetColor());
+  TakePiece<true>(location);
+}
+
+template <bool kUpdateState, bool kThroughRays>
+void Board::PlacePiece(
+    const BoardLocation& location,
+    const Piece& piece) {
+  location_to_piece_[location.Square()] = piece;
+  // Update bitboards and attack counts
+  int square = location.Square();
+  if (kUpdateState) {
+    UpdateAttacksAround<1, kThroughRays>(piece, square);
+  }
+  color_bb_[piece.GetColor()].Set(square);
+  piece_type_bb_[piece.GetPieceType()].Set(square);
+  occupied_bb_.Set(square);
+  if (!kUpdateState) {
+    return;
+  }
   UpdatePieceHash(piece, location);
   // Update king location
   if (piece.GetPieceType() == KING) {
@@ -956,22 +1152,29 @@ void Board::SetPiece(
     piece_evaluation_ -= piece_eval;
   }
   player_piece_evaluations_[piece.GetColor()] += piece_eval;
+  if (piece_square_table_ != nullptr) {
+    positional_evaluation_ += piece_square_table_->values
+      [piece.GetColor()][piece.GetPieceType()][square];
+  }
 }
 
-void Board::RemovePiece(const BoardLocation& location) {
+template <bool kUpdateState, bool kThroughRays>
+void Board::TakePiece(const BoardLocation& location) {
   const auto piece = GetPiece(location);
   assert(piece.Present());
-  UpdatePieceHash(piece, location);
-  location_to_piece_[location.GetRow()][location.GetCol()] = Piece();
-  auto& placed_pieces = piece_list_[piece.GetColor()];
-  for (auto it = placed_pieces.begin(); it != placed_pieces.end();) {
-    const auto& placed_piece = *it;
-    if (placed_piece.GetLocation() == location) {
-      placed_pieces.erase(it);
-      break;
-    }
-    ++it;
+  location_to_piece_[location.Square()] = Piece();
+  // Update bitboards and attack counts
+  int square = location.Square();
+  if (kUpdateState) {
+    UpdateAttacksAround<-1, kThroughRays>(piece, square);
+  }
+  color_bb_[piece.GetColor()].Clear(square);
+  piece_type_bb_[piece.GetPieceType()].Clear(square);
+  occupied_bb_.Clear(square);
+  if (!kUpdateState) {
+    return;
   }
+  UpdatePieceHash(piece, location);
   // Update king location
   if (piece.GetPieceType() == KING) {
     king_locations_[piece.GetColor()] = BoardLocation::kNoLocation;
@@ -984,6 +1187,10 @@ void Board::RemovePiece(const BoardLocation& location) {
     piece_evaluation_ += piece_eval;
   }
   player_piece_evaluations_[piece.GetColor()] -= piece_eval;
+  if (piece_square_table_ != nullptr) {
+    positional_evaluation_ -= piece_square_table_->values
+      [piece.GetColor()][piece.GetPieceType()][square];
+  }
 }
 
 void Board::InitializeHash() {
@@ -991,10 +1198,78 @@ void Board::InitializeHash() {
     for (const auto& placed_piece : piece_list_[color]) {
       UpdatePieceHash(placed_piece.GetPiece(), placed_piece.GetLocation());
     }
+    UpdateCastlingHash(static_cast<PlayerColor>(color),
+                       castling_rights_[color]);
+    const auto& enp_move = enp_.enp_moves[color];
+    if (enp_move.has_value()) {
+      PlayerColor player_color = static_cast<PlayerColor>(color);
+      SetEnpassantKey(player_color,
+                      EnpassantKey(*enp_move, Piece(player_color, PAWN)));
+    }
   }
   UpdateTurnHash(static_cast<int>(turn_.GetColor()));
 }
 
+int64_t Board::EnpassantKey(const Move& move, const Piece& piece) const {
+  if (piece.GetPieceType() != PAWN
+      || move.ManhattanDistance() != 2
+      || (move.From().GetRow() != move.To().GetRow()
+          && move.From().GetCol() != move.To().GetCol())) {
+    return 0;
+  }
+  // Capturable by an opponent's pawn that has the target square right in
+  // front of it.
+  const BoardLocation& to = move.To();
+  for (int offset : {1, 3}) {
+    PlayerColor color = static_cast<PlayerColor>(
+        (piece.GetColor() + offset) % 4);
+    if (GetPiece(to.Offset(-kPawnForward[color])) == Piece(color, PAWN)) {
+      return kZobristKeys.enpassant[to.Square()];
+    }
+  }
+  return 0;
+}
+
+int64_t Board::HashKeyAfter(const Move& move) const {
+  // Mirrors the hash updates of MakeMove.
+  const auto& pieces = kZobristKeys.pieces;
+  PlayerColor color = turn_.GetColor();
+  const Piece piece = GetPiece(move.From());
+  int64_t key = hash_key_;
+
+  const Piece standard_capture = GetPiece(move.To());
+  if (standard_capture.Present()) {
+    key ^= pieces[standard_capture.GetColor()]
+      [standard_capture.GetPieceType()][move.To().Square()];
+  }
+  const auto promotion_piece_type = move.GetPromotionPieceType();
+  key ^= pieces[color][piece.GetPieceType()][move.From().Square()];
+  key ^= pieces[color][promotion_piece_type != NO_PIECE
+    ? promotion_piece_type : piece.GetPieceType()][move.To().Square()];
+
+  const auto enpassant_location = move.GetEnpassantLocation();
+  if (enpassant_location.Present()) {
+    const Piece captured = GetPiece(enpassant_location);
+    key ^= pieces[captured.GetColor()][captured.GetPieceType()]
+      [enpassant_location.Square()];
+  } else {
+    const auto rook_move = move.GetRookMove();
+    if (rook_move.Present()) {
+      key ^= pieces[color][ROOK][rook_move.From().Square()]
+        ^ pieces[color][ROOK][rook_move.To().Square()];
+    }
+    const auto castling_rights = move.GetCastlingRights();
+    if (castling_rights.Present()) {
+      key ^= CastlingKey(color, castling_rights_[color])
+        ^ CastlingKey(color, castling_rights);
+    }
+  }
+
+  key ^= enpassant_keys_[color] ^ EnpassantKey(move, piece);
+  key ^= kZobristKeys.turns[color] ^ kZobristKeys.turns[(color + 1) % 4];
+  return key;
+}
+
 void Board::MakeMove(const Move& move) {
   // Cases:
   // 1. Move
@@ -1005,10 +1280,25 @@ void Board::MakeMove(const Move& move) {
 
   const auto piece = GetPiece(move.From());
 
-  // Capture
+  // Save everything that UndoMove restores by copy.
+  StateInfo& state = state_stack_.emplace_back();
+  state.hash_key = hash_key_;
+  state.pawn_key = pawn_key_;
+  state.piece_evaluation = piece_evaluation_;
+  state.positional_evaluation = positional_evaluation_;
+  for (int color = 0; color < 4; color++) {
+    state.player_piece_evaluations[color] = player_piece_evaluations_[color];
+    state.king_locations[color] = king_locations_[color];
+  }
+  state.castling_rights = castling_rights_[turn_.GetColor()];
+  state.enpassant_key = enpassant_keys_[turn_.GetColor()];
+  state.attack_counts = attack_counts_;
+
+  // Capture: the captured piece leaves the piece list here, and the board
+  // only once the moving piece has left its square (below).
   const auto standard_capture = GetPiece(move.To());
   if (standard_capture.Present()) {
-    RemovePiece(move.To());
+    RemoveFromPieceList(move.To(), standard_capture.GetColor());
   }
 
   if (piece.Missing()) {
@@ -1023,15 +1313,21 @@ void Board::MakeMove(const Move& move) {
   }
   assert(piece.Present());
 
-  RemovePiece(move.From());
+  // The moving piece keeps its slot in the piece list.
+  TakePiece<true>(move.From());
   const auto promotion_piece_type = move.GetPromotionPieceType();
-  if (promotion_piece_type != NO_PIECE) { // Promotion
-    SetPiece(
-        move.To(),
-        Piece(turn_.GetColor(), promotion_piece_type));
-  } else { // Move
-    SetPiece(move.To(), piece);
+  const Piece moved_piece = promotion_piece_type != NO_PIECE
+    ? Piece(turn_.GetColor(), promotion_piece_type)  // Promotion
+    : piece;  // Move
+  if (standard_capture.Present()) {
+    // The square stays occupied, so the rays of sliders through it do not
+    // change: only the attacks of the piece on it do.
+    TakePiece<true, false>(move.To());
+    PlacePiece<true, false>(move.To(), moved_piece);
+  } else {
+    PlacePiece<true>(move.To(), moved_piece);
   }
+  MoveInPieceList(move.From(), move.To(), moved_piece);
 
   // En-passant
   const auto enpassant_location = move.GetEnpassantLocation();
@@ -1043,17 +1339,22 @@ void Board::MakeMove(const Move& move) {
     if (rook_move.Present()) {
       const auto rook = GetPiece(rook_move.From());
       assert(rook.Present());
-      RemovePiece(rook_move.From());
-      SetPiece(rook_move.To(), rook);
+      TakePiece<true>(rook_move.From());
+      PlacePiece<true>(rook_move.To(), rook);
+      MoveInPieceList(rook_move.From(), rook_move.To(), rook);
     }
 
     // Castling: rights update
     const auto castling_rights = move.GetCastlingRights();
     if (castling_rights.Present()) {
+      UpdateCastlingHash(turn_.GetColor(), castling_rights_[turn_.GetColor()]);
       castling_rights_[turn_.GetColor()] = castling_rights;
+      UpdateCastlingHash(turn_.GetColor(), castling_rights);
     }
   }
 
+  SetEnpassantKey(turn_.GetColor(), EnpassantKey(move, piece));
+
   int t = static_cast<int>(turn_.GetColor());
   UpdateTurnHash(t);
   UpdateTurnHash((t+1)%4);
@@ -1085,46 +1386,56 @@ void Board::UndoMove() {
     abort();
   }
 
-  RemovePiece(to);
+  TakePiece<false>(to);
   const auto promotion_piece_type = move.GetPromotionPieceType();
-  if (promotion_piece_type != NO_PIECE) {
-    // Handle promotions
-    SetPiece(from, Piece(turn_before.GetColor(), PAWN));
-  } else {
-    SetPiece(from, piece);
-  }
+  const Piece moved_piece = promotion_piece_type != NO_PIECE
+    ? Piece(turn_before.GetColor(), PAWN)  // Handle promotions
+    : piece;
+  PlacePiece<false>(from, moved_piece);
+  MoveInPieceList(to, from, moved_piece);
 
   // Place back captured pieces
   const auto standard_capture = move.GetStandardCapture();
   if (standard_capture.Present()) {
-    SetPiece(to, standard_capture);
+    PlacePiece<false>(to, standard_capture);
+    AddToPieceList(to, standard_capture);
   }
 
   // Place back en-passant pawns
   const auto enpassant_location = move.GetEnpassantLocation();
   if (enpassant_location.Present()) {
-    SetPiece(enpassant_location,
+    PlacePiece<false>(enpassant_location,
              move.GetEnpassantCapture());
+    AddToPieceList(enpassant_location, move.GetEnpassantCapture());
   } else {
     // Castling: rook move
     const auto rook_move = move.GetRookMove();
     if (rook_move.Present()) {
-      RemovePiece(rook_move.To());
-      SetPiece(rook_move.From(), Piece(turn_before.GetColor(), ROOK));
+      const Piece rook(turn_before.GetColor(), ROOK);
+      TakePiece<false>(rook_move.To());
+      PlacePiece<false>(rook_move.From(), rook);
+      MoveInPieceList(rook_move.To(), rook_move.From(), rook);
     }
+  }
 
-    // Castling: rights update
-    const auto initial_castling_rights = move.GetInitialCastlingRights();
-    if (initial_castling_rights.Present()) {
-      castling_rights_[turn_before.GetColor()] = initial_castling_rights;
-    }
+  // Hash, material, positional sum, king locations, castling rights and
+  // attack counts are restored by copy rather than by replaying the updates.
+  const StateInfo& state = state_stack_.back();
+  hash_key_ = state.hash_key;
+  pawn_key_ = state.pawn_key;
+  piece_evaluation_ = state.piece_evaluation;
+  positional_evaluation_ = state.positional_evaluation;
+  for (int color = 0; color < 4; color++) {
+    player_piece_evaluations_[color] = state.player_piece_evaluations[color];
+    king_locations_[color] = state.king_locations[color];
   }
+  castling_rights_[turn_before.GetColor()] = state.castling_rights;
+  enpassant_keys_[turn_before.GetColor()] = state.enpassant_key;
+  attack_counts_ = state.attack_counts;
+  state_stack_.pop_back();
 
   turn_ = turn_before;
   moves_.pop_back();
-  int t = static_cast<int>(turn_.GetColor());
-  UpdateTurnHash(t);
-  UpdateTurnHash((t+1)%4);
 }
 
 BoardLocation Board::GetKingLocation(PlayerColor color) const {
@@ -1148,11 +1459,27 @@ int Board::PieceEvaluation(PlayerColor color) const {
   return player_piece_evaluations_[color];
 }
 
+void Board::SetPieceSquareTable(const PieceSquareTable* table) {
+  piece_square_table_ = table;
+  positional_evaluation_ = 0;
+  if (table == nullptr) {
+    return;
+  }
+  for (int color = 0; color < 4; color++) {
+    for (const auto& placed_piece : piece_list_[color]) {
+      positional_evaluation_ += table->values[color]
+        [placed_piece.GetPiece().GetPieceType()]
+        [placed_piece.GetLocation().Square()];
+    }
+  }
+}
+
 int Board::MobilityEvaluation(const Player& player) {
   Player turn = turn_;
   turn_ = player;
   int mobility = 0;
-  size_t num_moves = GetPseudoLegalMoves2(move_buffer_2_, move_buffer_size_);
+  Move moves[kMaxMovesPerPosition];
+  size_t num_moves = GetPseudoLegalMoves2(moves, kMaxMovesPerPosition);
   int player_mobility = (int) num_moves;
 
   if (player.GetTeam() == RED_YELLOW) {
@@ -1171,9 +1498,10 @@ int Board::MobilityEvaluation() {
   Player turn = turn_;
 
   int mobility = 0;
+  Move moves[kMaxMovesPerPosition];
   for (int player_color = 0; player_color < 4; ++player_color) {
     turn_ = Player(static_cast<PlayerColor>(player_color));
-    size_t num_moves = GetPseudoLegalMoves2(move_buffer_2_, move_buffer_size_);
+    size_t num_moves = GetPseudoLegalMoves2(moves, kMaxMovesPerPosition);
     int player_mobility = (int) num_moves;
 
     if (turn_.GetTeam() == RED_YELLOW) {
@@ -1194,8 +1522,8 @@ Board::Board(
     std::unordered_map<BoardLocation, Piece> location_to_piece,
     std::optional<std::unordered_map<Player, CastlingRights>> castling_rights,
     std::optional<EnpassantInitialization> enp)
-  : turn_(std::move(turn))
-    {
+  : Position() {
+  turn_ = std::move(turn);
 
   for (int color = 0; color < 4; color++) {
     castling_rights_[color] = CastlingRights(false, false);
@@ -1211,18 +1539,21 @@ Board::Board(
   if (enp.has_value()) {
     enp_ = std::move(*enp);
   }
-  move_buffer_.reserve(1000);
+  moves_.reserve(kStateStackReserve);
+  state_stack_.reserve(kStateStackReserve);
 
+  for (int square = 0; square < kNumSquares; ++square) {
+    location_to_piece_[square] = Piece::kOffBoard;
+  }
   for (int i = 0; i < 14; ++i) {
     for (int j = 0; j < 14; ++j) {
-      locations_[i][j] = BoardLocation(i, j);
-      location_to_piece_[i][j] = Piece();
+      if (IsLegalSquare(i, j)) {
+        location_to_piece_[SquareIndex(i, j)] = Piece();
+      }
     }
   }
 
   for (int i = 0; i < 4; i++) {
-    piece_list_.push_back(std::vector<PlacedPiece>());
-    piece_list_[i].reserve(16);
     king_locations_[i] = BoardLocation::kNoLocation;
   }
 
@@ -1230,10 +1561,11 @@ Board::Board(
     const auto& location = it.first;
     const auto& piece = it.second;
     PlayerColor color = piece.GetColor();
-    location_to_piece_[location.GetRow()][location.GetCol()] = piece;
-    piece_list_[piece.GetColor()].push_back(PlacedPiece(
-          locations_[location.GetRow()][location.GetCol()],
-          piece));
+    location_to_piece_[location.Square()] = piece;
+    color_bb_[color].Set(location.Square());
+    piece_type_bb_[piece.GetPieceType()].Set(location.Square());
+    occupied_bb_.Set(location.Square());
+    piece_list_[piece.GetColor()].Add(PlacedPiece(location, piece));
     PieceType piece_type = piece.GetPieceType();
     if (piece.GetTeam() == RED_YELLOW) {
       piece_evaluation_ += kPieceEvaluations[static_cast<int>(piece_type)];
@@ -1265,24 +1597,45 @@ Board::Board(
 
   for (auto& placed_pieces : piece_list_) {
     std::sort(placed_pieces.begin(), placed_pieces.end(), customLess);
+    for (size_t i = 0; i < placed_pieces.size(); i++) {
+      piece_index_[placed_pieces[i].GetLocation().Square()] = i;
+    }
   }
 
-  // Initialize hashes for each piece at each location, and each turn
-  std::srand(958829);
-  for (int color = 0; color < 4; color++) {
-    turn_hashes_[color] = rand64();
-  }
+  InitializeAttackCounts();
+
+  InitializeHash();
+}
+
+Board::Board(const Position& position) : Position(position) {
+  moves_.reserve(kStateStackReserve);
+  state_stack_.reserve(kStateStackReserve);
+
+  // A non-zero en-passant key is that of the target square of a pawn double
+  // step, which started two steps back.
   for (int color = 0; color < 4; color++) {
-    for (int piece_type = 0; piece_type < 6; piece_type++) {
-      for (int row = 0; row < 14; row++) {
-        for (int col = 0; col < 14; col++) {
-          piece_hashes_[color][piece_type][row][col] = rand64();
-        }
+    if (enpassant_keys_[color] == 0) {
+      continue;
+    }
+    for (int square = 0; square < kNumSquares; square++) {
+      if (kZobristKeys.enpassant[square] == enpassant_keys_[color]) {
+        BoardLocation to = BoardLocation::FromSquare(square);
+        enp_.enp_moves[color] = Move(to.Offset(-2 * kPawnForward[color]), to);
+        break;
       }
     }
   }
+}
 
-  InitializeHash();
+void Board::ReserveMoves() {
+  moves_.reserve(std::max(kStateStackReserve, moves_.size()));
+  state_stack_.reserve(std::max(kStateStackReserve, state_stack_.size()));
+}
+
+size_t Board::MemoryUsage() const {
+  return sizeof(Board)
+    + moves_.capacity() * sizeof(Move)
+    + state_stack_.capacity() * sizeof(StateInfo);
 }
 
 inline Team GetTeam(PlayerColor color) {
@@ -1466,7 +1819,7 @@ std::ostream& operator<<(
   for (int i = 0; i < 14; i++) {
     for (int j = 0; j < 14; j++) {
       if (board.IsLegalLocation(BoardLocation(i, j))) {
-        const auto piece = board.location_to_piece_[i][j];
+        const auto piece = board.GetPiece(i, j);
         if (piece.Missing()) {
           os << ".";
         } else {
@@ -1550,45 +1903,165 @@ std::string Move::PrettyStr() const {
 }
 
 bool Board::DeliversCheck(const Move& move) {
-  int color = GetTurn().GetColor();
-  Piece piece = GetPiece(move.From());
-
-  bool checks = false;
+  return DeliversCheck(move, GetCheckInfo());
+}
+
+CheckInfo Board::GetCheckInfo(bool discovered_checks) const {
+  CheckInfo check_info;
+  check_info.discovered_checks = discovered_checks;
+  PlayerColor color = turn_.GetColor();
+  Team team = turn_.GetTeam();
+  for (int i = 0; i < 2; i++) {
+    PlayerColor other = static_cast<PlayerColor>((color + 1 + 2 * i) % 4);
+    const auto& king_location = king_locations_[other];
+    if (!king_location.Present()) {
+      continue;
+    }
+    int king_square = king_location.Square();
+    check_info.king_squares[i] = king_square;
+
+    Bitboard* check_squares = check_info.check_squares[i];
+    check_squares[PAWN] = PawnAttackMask((color + 2) % 4, king_square);
+    check_squares[KNIGHT] = KnightMask(king_square);
+    check_squares[BISHOP] = BishopAttackMask(king_square, occupied_bb_);
+    check_squares[ROOK] = RookAttackMask(king_square, occupied_bb_);
+    check_squares[QUEEN] = check_squares[BISHOP] | check_squares[ROOK];
+    if (!discovered_checks) {
+      continue;
+    }
 
-  for (int add = 1; add < 4; add += 2) {
-    int other = (color + add) % 4;
-    auto king_loc = GetKingLocation(static_cast<PlayerColor>(other));
-    if (king_loc.Present()) {
-      if (king_loc == move.To()) {
-        checks = true;
-        break;
+    for (int dir = 0; dir < kNumDirections; dir++) {
+      int blocker = NearestPieceSquare(king_square, dir);
+      if (blocker == kNoSquare
+          || location_to_piece_[blocker].GetColor() != color) {
+        continue;
       }
-      switch (piece.GetPieceType()) {
-      case PAWN:
-        checks = PawnAttacks(move.To(), piece.GetColor(), king_loc);
-        break;
-      case KNIGHT:
-        checks = KnightAttacks(move.To(), king_loc);
-        break;
-      case BISHOP:
-        checks = BishopAttacks(move.To(), king_loc);
-        break;
-      case ROOK:
-        checks = RookAttacks(move.To(), king_loc);
-        break;
-      case QUEEN:
-        checks = QueenAttacks(move.To(), king_loc);
-        break;
-      default:
-        break;
+      int slider_square = NearestPieceSquare(blocker, dir);
+      if (slider_square == kNoSquare) {
+        continue;
       }
-      if (checks) {
-        break;
+      const auto& slider = location_to_piece_[slider_square];
+      PieceType slider_type = IsDiagonalDirection(dir) ? BISHOP : ROOK;
+      if (slider.GetTeam() == team
+          && (slider.GetPieceType() == QUEEN
+              || slider.GetPieceType() == slider_type)) {
+        check_info.discoverers[i].Set(blocker);
+      }
+    }
+  }
+  return check_info;
+}
+
+bool Board::DeliversCheck(
+    const Move& move, const CheckInfo& check_info) const {
+  const int from = move.From().Square();
+  const int to = move.To().Square();
+  const bool special_move = move.GetEnpassantLocation().Present()
+    || move.GetRookMove().Present()
+    || move.GetPromotionPieceType() != NO_PIECE;
+  PieceType piece_type = GetPiece(move.From()).GetPieceType();
+
+  for (int i = 0; i < 2; i++) {
+    int king_square = check_info.king_squares[i];
+    if (king_square == kNoSquare) {
+      continue;
+    }
+    if (king_square == to) {
+      return true;
+    }
+    if (!check_info.discovered_checks) {
+      if (check_info.check_squares[i][piece_type].Test(to)) {
+        return true;
+      }
+      continue;
+    }
+    // A slider moving along a line from the king may leave the line open
+    // behind it, which check_squares does not see.
+    bool along_line = (piece_type == BISHOP || piece_type == ROOK
+                       || piece_type == QUEEN)
+      && GetDirection(king_square, from) != NO_DIRECTION
+      && GetDirection(king_square, from) == GetDirection(king_square, to);
+    if (special_move || along_line) {
+      if (DeliversCheckAfterMove(move, king_square)) {
+        return true;
       }
+      continue;
+    }
+    if (check_info.check_squares[i][piece_type].Test(to)) {
+      return true;
+    }
+    // Discovered check: the piece leaves the line to the king
+    if (check_info.discoverers[i].Test(from)
+        && GetDirection(king_square, to) != GetDirection(king_square, from)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Board::DeliversCheckAfterMove(
+    const Move& move, int king_square) const {
+  const Piece piece = GetPiece(move.From());
+  const int to = move.To().Square();
+  PieceType piece_type = move.GetPromotionPieceType() != NO_PIECE
+    ? move.GetPromotionPieceType() : piece.GetPieceType();
+
+  Bitboard occupied = occupied_bb_;
+  occupied.Clear(move.From().Square());
+  occupied.Set(to);
+  const auto enpassant_location = move.GetEnpassantLocation();
+  if (enpassant_location.Present()) {
+    occupied.Clear(enpassant_location.Square());
+  }
+  const auto rook_move = move.GetRookMove();
+  if (rook_move.Present()) {
+    occupied.Clear(rook_move.From().Square());
+    occupied.Set(rook_move.To().Square());
+    if (RookAttackMask(rook_move.To().Square(), occupied).Test(king_square)) {
+      return true;
     }
   }
 
-  return checks;
+  // Direct check by the moved (or promoted) piece
+  Bitboard attacks;
+  switch (piece_type) {
+  case PAWN:
+    attacks = PawnAttackMask(piece.GetColor(), to);
+    break;
+  case KNIGHT:
+    attacks = KnightMask(to);
+    break;
+  case BISHOP:
+    attacks = BishopAttackMask(to, occupied);
+    break;
+  case ROOK:
+    attacks = RookAttackMask(to, occupied);
+    break;
+  case QUEEN:
+    attacks = QueenAttackMask(to, occupied);
+    break;
+  default:
+    break;
+  }
+  if (attacks.Test(king_square)) {
+    return true;
+  }
+
+  // Discovered check: a slider of the team that reaches the king only with
+  // the new occupancy
+  Bitboard team_bb = GetTeamBitboard(piece.GetTeam());
+  Bitboard rooks_queens =
+    (piece_type_bb_[ROOK] | piece_type_bb_[QUEEN]) & team_bb;
+  Bitboard bishops_queens =
+    (piece_type_bb_[BISHOP] | piece_type_bb_[QUEEN]) & team_bb;
+  Bitboard discovered =
+    (RookAttackMask(king_square, occupied)
+       .AndNot(RookAttackMask(king_square, occupied_bb_)) & rooks_queens)
+    | (BishopAttackMask(king_square, occupied)
+       .AndNot(BishopAttackMask(king_square, occupied_bb_)) & bishops_queens);
+  // Pieces that moved away no longer count.
+  discovered &= occupied;
+  return discovered.Any();
 }
 
 void Board::MakeNullMove() {
@@ -1614,6 +2087,13 @@ bool Move::DeliversCheck(Board& board) {
   return delivers_check_;
 }
 
+bool Move::DeliversCheck(const Board& board, const CheckInfo& check_info) {
+  if (delivers_check_ < 0) {
+    delivers_check_ = board.DeliversCheck(*this, check_info);
+  }
+  return delivers_check_;
+}
+
 int Move::SEE(Board& board,
                const int* piece_evaluations) {
   if (see_ == kSeeNotSet) {
@@ -1630,86 +2110,13 @@ int Move::ApproxSEE(Board& board, const int* piece_evaluations) {
   return captured_val - attacker_val;
 }
 
-namespace {
-
-int StaticExchangeEvaluationFromLists(
-    int square_piece_eval,
-    const std::vector<int>& sorted_piece_values,
-    size_t index,
-    const std::vector<int>& other_team_sorted_piece_values,
-    size_t other_index) {
-  if (index >= sorted_piece_values.size()) {
-    return 0;
-  }
-  int value_capture = square_piece_eval - StaticExchangeEvaluationFromLists(
-      sorted_piece_values[index],
-      other_team_sorted_piece_values,
-      other_index,
-      sorted_piece_values,
-      index + 1);
-  return std::max(0, value_capture);
-}
-
-int StaticExchangeEvaluationFromLocation(
-    const int piece_evaluations[6],
-    const Board& board, const BoardLocation& loc) {
-  constexpr size_t kLimit = 5;
-  PlacedPiece attackers_this_side[kLimit];
-  PlacedPiece attackers_that_side[kLimit];
-
-  size_t num_attackers_this_side = board.GetAttackers2(
-      attackers_this_side, kLimit, board.GetTurn().GetTeam(), loc);
-  size_t num_attackers_that_side = board.GetAttackers2(
-      attackers_that_side, kLimit, OtherTeam(board.GetTurn().GetTeam()), loc);
-
-  std::vector<int> piece_values_this_side;
-  piece_values_this_side.reserve(num_attackers_this_side);
-  std::vector<int> piece_values_that_side;
-  piece_values_that_side.reserve(num_attackers_that_side);
-
-  for (size_t i = 0; i < num_attackers_this_side; ++i) {
-    const auto& placed_piece = attackers_this_side[i];
-    int piece_eval = piece_evaluations[placed_piece.GetPiece().GetPieceType()];
-    piece_values_this_side.push_back(piece_eval);
-  }
-
-  for (size_t i = 0; i < num_attackers_that_side; ++i) {
-    const auto& placed_piece = attackers_that_side[i];
-    int piece_eval = piece_evaluations[placed_piece.GetPiece().GetPieceType()];
-    piece_values_that_side.push_back(piece_eval);
-  }
-
-  std::sort(piece_values_this_side.begin(), piece_values_this_side.end());
-  std::sort(piece_values_that_side.begin(), piece_values_that_side.end());
-
-  const auto attacking = board.GetPiece(loc);
-  assert(attacking.Present());
-  int attacked_piece_eval = piece_evaluations[attacking.GetPieceType()];
-
-  return StaticExchangeEvaluationFromLists(
-      attacked_piece_eval,
-      piece_values_this_side,
-      0,
-      piece_values_that_side,
-      0);
-}
-
-} // namespace
-
 int StaticExchangeEvaluationCapture(
     const int piece_evaluations[6],
     Board& board,
     const Move& move) {
 
-  const auto captured = move.GetCapturePiece();
-  assert(captured.Present());
-
-  int value = piece_evaluations[captured.GetPieceType()];
-
-  board.MakeMove(move);
-  value -= StaticExchangeEvaluationFromLocation(piece_evaluations, board, move.To());
-  board.UndoMove();
-  return value;
+  assert(move.GetCapturePiece().Present());
+  return board.StaticExchangeEvaluation(move, piece_evaluations);
 }
 
 
@@ -3,18 +3,24 @@
 
 // Classes for a 4-player teams chess board (chess.com variant).
 
+#include <cassert>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <ostream>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <iostream>
 
+#include "bitboard.h"
+
 namespace chess {
 
 class Board;
+struct CheckInfo;
 
 constexpr int kNumPieceTypes = 6;
 
@@ -133,6 +139,11 @@ class Piece {
     return static_cast<PieceType>((bits_ & 0b00011100) >> 2);
   }
 
+  // Sentinel stored on squares outside the board (padding and the dead
+  // corners). It counts as present, so that square-by-square walks stop
+  // on it, but it belongs to no player.
+  bool OffBoard() const { return bits_ == kOffBoardBits; }
+
   bool operator==(const Piece& other) const { return bits_ == other.bits_; }
   bool operator!=(const Piece& other) const { return bits_ != other.bits_; }
 
@@ -142,8 +153,12 @@ class Piece {
       std::ostream& os, const Piece& piece);
 
   static Piece kNoPiece;
+  static Piece kOffBoard;
 
  private:
+  // Present, piece type 7.
+  static constexpr int8_t kOffBoardBits = static_cast<int8_t>(0b10011100);
+
   // bit 0: presence
   // bit 1-2: player
   // bit 3-5: piece type
@@ -155,21 +170,36 @@ class Piece {
 
 class BoardLocation {
  public:
-  BoardLocation() : loc_(196) {}
+  BoardLocation() : loc_(kNoSquare) {}
   BoardLocation(int8_t row, int8_t col) {
     loc_ = (row < 0 || row >= 14 || col < 0 || col >= 14)
-      ? 196 : 14 * row + col;
+      ? kNoSquare : SquareIndex(row, col);
   }
 
-  bool Present() const { return loc_ < 196; }
+  bool Present() const { return loc_ != kNoSquare; }
   bool Missing() const { return !Present(); }
-  int8_t GetRow() const { return loc_ / 14; }
-  int8_t GetCol() const { return loc_ % 14; }
+  int8_t GetRow() const { return SquareRow(loc_); }
+  int8_t GetCol() const { return SquareCol(loc_); }
 
   BoardLocation Relative(int8_t delta_row, int8_t delta_col) const {
     return BoardLocation(GetRow() + delta_row, GetCol() + delta_col);
   }
 
+  // Index of the location in the padded board array and in Bitboards.
+  int Square() const { return loc_; }
+  static BoardLocation FromSquare(int square) {
+    BoardLocation location;
+    location.loc_ = square;
+    return location;
+  }
+
+  // Steps `offset` squares in the padded layout (e.g. -16 is one row up).
+  // Stepping off the 14x14 board lands on a padding square, which holds the
+  // off-board sentinel in the board array, so no bounds checks are needed.
+  BoardLocation Offset(int offset) const {
+    return FromSquare(static_cast<uint8_t>(loc_ + offset));
+  }
+
   bool operator==(const BoardLocation& other) const { return loc_ == other.loc_; }
   bool operator!=(const BoardLocation& other) const { return loc_ != other.loc_; }
 
@@ -180,8 +210,10 @@ class BoardLocation {
   static BoardLocation kNoLocation;
 
  private:
-  // value 0-195: 1 + 14*row + col
-  // value 196: not present
+  // value: 16*row + col, in a 16x16 layout where rows and columns 14-15 are
+  // padding. Wrap-around of the uint8 makes negative steps from row 0 or
+  // column 0 land on padding as well.
+  // value 255: not present
   uint8_t loc_;
 };
 
@@ -360,8 +392,9 @@ class Move {
   friend std::ostream& operator<<(
       std::ostream& os, const Move& move);
   std::string PrettyStr() const;
-  // NOTE: This does not find discovered checks.
+  // Direct and discovered checks on either enemy king. Cached in the move.
   bool DeliversCheck(Board& board);
+  bool DeliversCheck(const Board& board, const CheckInfo& check_info);
   int SEE(Board& board, const int* piece_evaluations);
   int ApproxSEE(Board& board, const int* piece_evaluations);
 
@@ -398,6 +431,140 @@ class Move {
   int see_ = kSeeNotSet;
 };
 
+// A move packed into 32 bits, for tables that outlive the position the move
+// was generated in (transposition table, killers, counter moves). It keeps
+// the squares, the promotion piece type and the kind of move; captured
+// pieces, castling rights and the rook move follow from the position, see
+// Board::UnpackMove.
+class PackedMove {
+ public:
+  enum Kind : uint8_t {
+    NORMAL = 0,
+    EN_PASSANT = 1,
+    CASTLING = 2,
+  };
+
+  PackedMove() = default;
+  explicit PackedMove(const Move& move) {
+    if (!move.Present()) {
+      return;
+    }
+    Kind kind = move.GetEnpassantLocation().Present() ? EN_PASSANT
+      : move.GetRookMove().Present() ? CASTLING : NORMAL;
+    data_ = static_cast<uint32_t>(move.From().Square())
+      | static_cast<uint32_t>(move.To().Square()) << 8
+      | static_cast<uint32_t>(move.GetPromotionPieceType()) << 16
+      | static_cast<uint32_t>(kind) << 19;
+  }
+
+  bool Present() const { return data_ != 0; }
+  int From() const { return data_ & 0xFF; }
+  int To() const { return (data_ >> 8) & 0xFF; }
+  PieceType GetPromotionPieceType() const {
+    return static_cast<PieceType>((data_ >> 16) & 0x7);
+  }
+  Kind GetKind() const { return static_cast<Kind>((data_ >> 19) & 0x3); }
+
+  // The 32-bit encoding, for tables that store the move in a wider word.
+  uint32_t Bits() const { return data_; }
+  static PackedMove FromBits(uint32_t bits) {
+    PackedMove packed;
+    packed.data_ = bits;
+    return packed;
+  }
+
+  bool operator==(const PackedMove& other) const {
+    return data_ == other.data_;
+  }
+  bool operator!=(const PackedMove& other) const {
+    return data_ != other.data_;
+  }
+
+ private:
+  // from (8 bits) | to (8) | promotion piece type (3) | kind (2)
+  uint32_t data_ = 0;
+};
+
+// Zobrist keys shared by all boards. Built at compile time from a fixed
+// seed, so hash keys are the same in every run and every thread.
+constexpr uint64_t kZobristSeed = 958829;
+struct ZobristKeys {
+  // Indexed by [color][piece_type][square].
+  int64_t pieces[4][6][kNumSquares];
+  int64_t turns[4];
+  // Indexed by [color][CastlingType], set while that right is held.
+  int64_t castling[4][2];
+  // Indexed by the square a pawn has just double-stepped to, set until its
+  // player moves again.
+  int64_t enpassant[kNumSquares];
+};
+
+// Defined in board.cc as a constexpr object.
+extern const ZobristKeys kZobristKeys;
+
+// Orientation of a color on the board, as compile-time constants for the
+// move generators and evaluation terms that are specialized on PlayerColor.
+// Red and yellow pawns advance along a column, blue and green pawns along a
+// row.
+template <PlayerColor kColor>
+struct ColorGeometry {
+  static constexpr Team kTeam =
+    kColor == RED || kColor == YELLOW ? RED_YELLOW : BLUE_GREEN;
+  static constexpr bool kAdvancesAlongColumn = kTeam == RED_YELLOW;
+  // One step forward, by row and by column.
+  static constexpr int kForwardRow =
+    kColor == RED ? -1 : kColor == YELLOW ? 1 : 0;
+  static constexpr int kForwardCol =
+    kColor == BLUE ? 1 : kColor == GREEN ? -1 : 0;
+  // Forward step, and the sideways step of pawn captures, in the padded
+  // square layout.
+  static constexpr int kForward = 16 * kForwardRow + kForwardCol;
+  static constexpr int kSideways = kAdvancesAlongColumn ? 1 : 16;
+  // Row (red, yellow) or column (blue, green) of unmoved pawns, and of
+  // promotion.
+  static constexpr int kPawnStartLine =
+    kColor == RED || kColor == GREEN ? 12 : 1;
+  static constexpr int kPromotionLine =
+    kColor == RED || kColor == GREEN ? 3 : 10;
+  // Step from the king towards its kingside rook.
+  static constexpr int kKingsideStep =
+    kColor == RED ? 1 : kColor == BLUE ? 16 : kColor == YELLOW ? -1 : -16;
+
+  static int Line(const BoardLocation& location) {
+    return kAdvancesAlongColumn ? location.GetRow() : location.GetCol();
+  }
+  // Number of steps a pawn on the location has advanced.
+  static int PawnAdvancement(const BoardLocation& location) {
+    return (Line(location) - kPawnStartLine) * (kForwardRow + kForwardCol);
+  }
+};
+
+// What the side to move needs to know to tell whether a move gives check,
+// computed once per node by Board::GetCheckInfo. Index 0 is the next
+// player's king, index 1 the previous player's.
+struct CheckInfo {
+  // kNoSquare if the king is gone.
+  int king_squares[2] = {kNoSquare, kNoSquare};
+  // By piece type: squares from which a piece of the side to move attacks
+  // the king.
+  Bitboard check_squares[2][6];
+  // Pieces of the side to move that are the only piece between the king
+  // and a slider of their team.
+  Bitboard discoverers[2];
+  // If false, only direct checks by the moved piece count, looked up in
+  // check_squares by its type before promotion.
+  bool discovered_checks = true;
+};
+
+// Subsets of the legal moves, for staged move generation.
+enum MoveGenType {
+  ALL_MOVES = 0,
+  // Standard and en-passant captures.
+  CAPTURES = 1,
+  // Everything else, including castling and non-capturing promotions.
+  QUIETS = 2,
+};
+
 enum GameResult {
   IN_PROGRESS = 0,
   WIN_RY = 1,
@@ -425,6 +592,42 @@ class PlacedPiece {
   Piece piece_;
 };
 
+// The pieces of one color, stored inline with a fixed capacity. Removal
+// moves the last piece into the freed slot; the Board keeps the slot of each
+// occupied square so that it never has to search the list.
+class PieceList {
+ public:
+  static constexpr int kCapacity = 32;
+
+  const PlacedPiece* begin() const { return pieces_; }
+  const PlacedPiece* end() const { return pieces_ + size_; }
+  PlacedPiece* begin() { return pieces_; }
+  PlacedPiece* end() { return pieces_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const PlacedPiece& operator[](size_t index) const { return pieces_[index]; }
+
+  // Appends the piece and returns its slot.
+  int Add(const PlacedPiece& placed_piece) {
+    assert(size_ < kCapacity);
+    pieces_[size_] = placed_piece;
+    return size_++;
+  }
+  // Removes the piece in the slot. Returns the piece that now occupies the
+  // slot, if any.
+  const PlacedPiece* RemoveAt(int index) {
+    pieces_[index] = pieces_[--size_];
+    return index < size_ ? &pieces_[index] : nullptr;
+  }
+  void Replace(int index, const PlacedPiece& placed_piece) {
+    pieces_[index] = placed_piece;
+  }
+
+ private:
+  PlacedPiece pieces_[kCapacity];
+  int size_ = 0;
+};
+
 struct EnpassantInitialization {
   // Indexed by PlayerColor
   std::optional<Move> enp_moves[4] = {std::nullopt, std::nullopt, std::nullopt, std::nullopt};
@@ -446,7 +649,67 @@ struct MoveBuffer {
 };
 
 
-class Board {
+// Positional value of a piece on a square, supplied by the evaluator and
+// summed incrementally by the Board. Indexed by (color, piece type,
+// BoardLocation::Square()), signed w.r.t. the RY team.
+struct PieceSquareTable {
+  int values[4][6][kNumSquares];
+};
+
+// Moves for which a Board reserves its move and undo stacks up front:
+// the search depth (kMaxPly in player.h) on top of a long game.
+constexpr size_t kStateStackReserve = 1024;
+
+// Upper bound on the pseudo-legal moves of one player, for move buffers on
+// the stack.
+constexpr size_t kMaxMovesPerPosition = 300;
+
+// The state of a game that does not depend on how it was reached: pieces,
+// bitboards, attack counts, castling rights, evaluation sums and hash keys.
+// Trivially copyable, so positions can be copied with memcpy and stored in
+// bulk; the move history and the undo stack live in Board. A value-
+// initialized Position (`Position()`) has all counters and keys at zero.
+struct Position {
+  Player turn_;
+
+  // Indexed by BoardLocation::Square(). Padding squares and the dead corners
+  // hold Piece::kOffBoard.
+  Piece location_to_piece_[kNumSquares];
+  PieceList piece_list_[4];
+  // Slot in piece_list_ of the piece on each occupied square.
+  uint8_t piece_index_[kNumSquares];
+
+  // Bitboards, kept in sync with location_to_piece_ by SetPiece/RemovePiece.
+  Bitboard color_bb_[4];
+  Bitboard piece_type_bb_[6];
+  Bitboard occupied_bb_;
+  // Per team (RED_YELLOW, BLUE_GREEN): number of attackers of each square,
+  // stored bit-sliced (bit i of every count lives in planes[team][i]) so that
+  // a whole attack set is added with a few word operations. A square has at
+  // most 16 direct attackers, which fits in 5 bits.
+  static constexpr int kAttackCountBits = 5;
+  struct AttackCounts {
+    Bitboard planes[2][kAttackCountBits];
+  };
+  AttackCounts attack_counts_;
+
+  CastlingRights castling_rights_[4];
+  int piece_evaluation_;
+  int player_piece_evaluations_[4]; // one per player
+  const PieceSquareTable* piece_square_table_;
+  int positional_evaluation_;
+
+  int64_t hash_key_;
+  int64_t pawn_key_;
+  // En-passant key of each color's last move (0 unless it was a pawn double
+  // step), as included in hash_key_.
+  int64_t enpassant_keys_[4];
+  BoardLocation king_locations_[4];
+};
+static_assert(std::is_trivially_copyable_v<Position>);
+static_assert(std::is_standard_layout_v<Position>);
+
+class Board : private Position {
  // Conventions:
  // - Red is on the bottom of the board, blue on the left, yellow on top,
  //   green on the right
@@ -461,9 +724,34 @@ class Board {
         castling_rights = std::nullopt,
       std::optional<EnpassantInitialization> enp = std::nullopt);
 
+  // Starts a game at the position, with an empty move history. En-passant
+  // captures of the last double steps are recovered from the position's
+  // en-passant keys.
+  explicit Board(const Position& position);
+  // Copies hold only the history they copy; call ReserveMoves before
+  // searching from one.
   Board(const Board&) = default;
+  Board& operator=(const Board&) = default;
+
+  const Position& GetPosition() const { return *this; }
+  // Reserves the move and undo stacks for kStateStackReserve moves, like
+  // the other constructors do, so that a search does not reallocate them.
+  void ReserveMoves();
+  // Bytes held by the board, including its move and undo stacks.
+  size_t MemoryUsage() const;
 
   size_t GetPseudoLegalMoves2(Move* buffer, size_t limit);
+  // The pseudo-legal move of the side to move that packs to `packed`, or
+  // nullopt if there is none (e.g. after a hash collision).
+  std::optional<Move> UnpackMove(const PackedMove& packed) const;
+  // Moves that do not leave the mover's king attacked, in the same order as
+  // GetPseudoLegalMoves2. Moves that capture a king end the game and are
+  // always included.
+  size_t GetLegalMoves(Move* buffer, size_t limit,
+                       MoveGenType type = ALL_MOVES);
+  // Whether the move (e.g. from the TT or a killer slot) is a legal move of
+  // the side to move in this position.
+  bool IsLegalMove(const Move& move);
 
   bool IsKingInCheck(const Player& player) const;
   bool IsKingInCheck(Team team) const;
@@ -474,12 +762,33 @@ class Board {
   Team TeamToPlay() const;
   int PieceEvaluation() const;
   int PieceEvaluation(PlayerColor color) const;
+  // Sum of the piece-square table over all pieces, w.r.t. RY team, or 0 if
+  // no table is set.
+  int PositionalEvaluation() const { return positional_evaluation_; }
+  // Not owned: the table must outlive this board and its copies. nullptr
+  // disables the positional sum.
+  void SetPieceSquareTable(const PieceSquareTable* table);
   int MobilityEvaluation();
   int MobilityEvaluation(const Player& player);
   const Player& GetTurn() const { return turn_; }
+  // O(1): reads the incrementally maintained attack counts.
   bool IsAttackedByTeam(
       Team team,
       const BoardLocation& location) const;
+  // Number of pieces of the team (RED_YELLOW or BLUE_GREEN) that attack the
+  // location, counting x-rays only when nothing is in between.
+  int GetAttackCount(Team team, const BoardLocation& location) const {
+    int count = 0;
+    for (int bit = 0; bit < kAttackCountBits; bit++) {
+      count |= attack_counts_.planes[team][bit].Test(location.Square()) << bit;
+    }
+    return count;
+  }
+  // Squares attacked by at least one piece of the team.
+  Bitboard GetAttackedSquares(Team team) const {
+    const Bitboard* counts = attack_counts_.planes[team];
+    return counts[0] | counts[1] | counts[2] | counts[3] | counts[4];
+  }
 
 //  std::vector<PlacedPiece> GetAttackers(
 //      Team team, const BoardLocation& location,
@@ -489,16 +798,34 @@ class Board {
       PlacedPiece* buffer, size_t limit,
       Team team, const BoardLocation& location) const;
 
+  // Static exchange evaluation of a capture, computed on the occupancy
+  // without making the move: the material the mover's team wins if both
+  // teams keep recapturing on the target square with their least valuable
+  // attacker, each free to stop. Sliders behind a capturing piece join as
+  // x-rays.
+  int StaticExchangeEvaluation(
+      const Move& move, const int piece_evaluations[6]) const;
+  // Whether StaticExchangeEvaluation(move) >= threshold. Stops as soon as
+  // the outcome is decided.
+  bool StaticExchangeEvaluationGe(
+      const Move& move, int threshold, const int piece_evaluations[6]) const;
+
   BoardLocation GetKingLocation(PlayerColor color) const;
   bool DeliversCheck(const Move& move);
+  // Check squares and discovered-check candidates of the side to move.
+  CheckInfo GetCheckInfo(bool discovered_checks = true) const;
+  // Whether the move of the side to move gives check, directly or by
+  // uncovering a slider of its team. King moves never check directly.
+  bool DeliversCheck(const Move& move, const CheckInfo& check_info) const;
 
   const Piece& GetPiece(
       int row, int col) const {
-    return location_to_piece_[row][col];
+    return location_to_piece_[SquareIndex(row, col)];
   }
+  // Returns Piece::kOffBoard for locations outside the board.
   const Piece& GetPiece(
       const BoardLocation& location) const {
-    return GetPiece(location.GetRow(), location.GetCol());
+    return location_to_piece_[location.Square()];
   }
   inline bool IsOnPathBetween(
       const BoardLocation& from,
@@ -511,6 +838,18 @@ class Board {
       Team attacking_team) const;
 
   int64_t HashKey() const { return hash_key_; }
+  // HashKey() once the pseudo-legal move is made, without making it (e.g. to
+  // prefetch the transposition table entry of the child).
+  int64_t HashKeyAfter(const Move& move) const;
+  // Hash key of the position in which Moves()[index] was played, e.g. for
+  // repetition detection.
+  int64_t HashKeyBeforeMove(size_t index) const {
+    return state_stack_[index].hash_key;
+  }
+
+  // Zobrist key of the pawns and kings only, for caching pawn structure and
+  // king shelter terms.
+  int64_t PawnKey() const { return pawn_key_; }
 
   static std::shared_ptr<Board> CreateStandardSetup();
 //  bool operator==(const Board& other) const;
@@ -536,32 +875,53 @@ class Board {
   void GetKnightMoves2(
       MoveBuffer& moves,
       const BoardLocation& from,
-      const Piece& piece) const;
+      const Piece& piece,
+      const Bitboard& allowed = ~Bitboard()) const;
   void GetBishopMoves2(
       MoveBuffer& moves,
       const BoardLocation& from,
-      const Piece& piece) const;
+      const Piece& piece,
+      const Bitboard& allowed = ~Bitboard()) const;
   void GetRookMoves2(
       MoveBuffer& moves,
       const BoardLocation& from,
-      const Piece& piece) const;
+      const Piece& piece,
+      const Bitboard& allowed = ~Bitboard()) const;
   void GetQueenMoves2(
       MoveBuffer& moves,
       const BoardLocation& from,
-      const Piece& piece) const;
+      const Piece& piece,
+      const Bitboard& allowed = ~Bitboard()) const;
   void GetKingMoves2(
       MoveBuffer& moves,
       const BoardLocation& from,
       const Piece& piece) const;
-  void AddMovesFromIncrMovement2(
+  // Pseudo-legal moves of the piece on `from`.
+  void GetPieceMoves2(
+      MoveBuffer& moves,
+      const BoardLocation& from,
+      const Piece& piece) const;
+  // Adds a move from `from` to each square in `targets`, which must not
+  // contain pieces of the moving team.
+  void AddMovesToTargets2(
       MoveBuffer& moves,
-      const Piece& piece,
       const BoardLocation& from,
-      int incr_row,
-      int incr_col,
+      Bitboard targets,
       CastlingRights initial_castling_rights = CastlingRights::kMissingRights,
       CastlingRights castling_rights = CastlingRights::kMissingRights) const;
 
+  const Bitboard& GetOccupiedBitboard() const { return occupied_bb_; }
+  const Bitboard& GetColorBitboard(PlayerColor color) const {
+    return color_bb_[color];
+  }
+  const Bitboard& GetPieceTypeBitboard(PieceType piece_type) const {
+    return piece_type_bb_[piece_type];
+  }
+  Bitboard GetTeamBitboard(Team team) const {
+    // RED_YELLOW = RED | YELLOW, BLUE_GREEN = BLUE | GREEN
+    return color_bb_[team] | color_bb_[team + 2];
+  }
+
 
   friend std::ostream& operator<<(
       std::ostream& os, const Board& board);
@@ -574,31 +934,17 @@ class Board {
   void UndoNullMove();
 
   bool IsLegalLocation(int row, int col) const {
-    if (row < 0
-        || row > GetMaxRow()
-        || col < 0
-        || col > GetMaxCol()
-        || (row < 3 && (col < 3 || col > 10))
-        || (row > 10 && (col < 3 || col > 10))) {
-      return false;
-    }
-    return true;
+    return row >= 0 && row <= GetMaxRow() && col >= 0 && col <= GetMaxCol()
+        && !GetPiece(row, col).OffBoard();
   }
   bool IsLegalLocation(const BoardLocation& location) const {
-    return IsLegalLocation(location.GetRow(), location.GetCol());
+    return !GetPiece(location).OffBoard();
   }
   const EnpassantInitialization& GetEnpassantInitialization() { return enp_; }
-  const std::vector<std::vector<PlacedPiece>>& GetPieceList() { return piece_list_; };
+  // Indexed by PlayerColor.
+  const PieceList* GetPieceList() const { return piece_list_; };
 
  private:
-  void AddMovesFromIncrMovement(
-      std::vector<Move>& moves,
-      const Piece& piece,
-      const BoardLocation& from,
-      int incr_row,
-      int incr_col,
-      CastlingRights initial_castling_rights = CastlingRights::kMissingRights,
-      CastlingRights castling_rights = CastlingRights::kMissingRights) const;
   int GetMaxRow() const { return 13; }
   int GetMaxCol() const { return 13; }
   std::optional<CastlingType> GetRookLocationType(
@@ -626,36 +972,154 @@ class Board {
       PlayerColor pawn_color,
       const BoardLocation& other_loc) const;
 
+  // Nearest occupied square from `square` in direction `dir`, or kNoSquare.
+  // Steps through the padded mailbox until a piece or the off-board
+  // sentinel is hit.
+  int NearestPieceSquare(int square, int dir) const {
+    do {
+      square = (square + kDirectionStep[dir]) & 0xFF;
+    } while (location_to_piece_[square].Missing());
+    return location_to_piece_[square].OffBoard() ? kNoSquare : square;
+  }
+  // Pieces of the team that attack the square.
+  Bitboard GetAttackersBitboard(Team team, int square) const;
+  // Pieces of both teams that attack the square, with sliders seeing
+  // through the squares missing from `occupied`.
+  Bitboard GetAttackersBitboard(int square, const Bitboard& occupied) const;
+  // Check test on the occupancy after the move, for the moves that
+  // CheckInfo does not cover: en-passant, castling, promotions, and sliders
+  // moving along a line from the king.
+  bool DeliversCheckAfterMove(const Move& move, int king_square) const;
+  // Occupancy once the capturing piece (and an en-passant pawn) has left
+  // its square, for static exchange evaluation.
+  Bitboard GetExchangeOccupancy(const Move& move) const;
+  // Pieces of the side to move that are pinned to its king by a slider of
+  // either enemy color.
+  Bitboard GetPinnedPieces(int king_square) const;
+  // Pseudo-legal moves in which knights and sliders only move to
+  // `targets`. Pawn and king moves are generated in full. Dispatches once on
+  // the side to move.
+  size_t GetMovesToTargets(Move* buffer, size_t limit,
+                           const Bitboard& targets);
+  template <PlayerColor kColor>
+  size_t GetMovesToTargets(Move* buffer, size_t limit,
+                           const Bitboard& targets);
+  template <PlayerColor kColor>
+  void GetPawnMoves(MoveBuffer& moves, const BoardLocation& from) const;
+  template <PlayerColor kColor>
+  void GetKingMoves(MoveBuffer& moves, const BoardLocation& from) const;
+  // Whether a pseudo-legal move leaves the mover's king unattacked, given
+  // the checkers and pinned pieces of the current position.
+  bool IsLegalPseudoLegalMove(const Move& move, int king_square,
+                              const Bitboard& checkers,
+                              const Bitboard& pinned);
+
+  // Squares attacked by the piece standing on the square (used to build the
+  // attack counts from scratch).
+  Bitboard GetPieceAttacks(const Piece& piece, int square) const;
+  // Adds delta (+1 or -1) to the attack count of each square in the set,
+  // as a ripple-carry add over the bit planes.
+  void UpdateAttackCounts(Team team, Bitboard squares, int delta) {
+    Bitboard* counts = attack_counts_.planes[team];
+    for (int bit = 0; bit < kAttackCountBits && squares.Any(); bit++) {
+      Bitboard carry = delta > 0 ? counts[bit] & squares
+                                 : squares.AndNot(counts[bit]);
+      counts[bit] ^= squares;
+      squares = carry;
+    }
+  }
+  // Adds kDelta to the counts of the squares attacked by the piece on
+  // `square`, and -kDelta to the squares behind it on the rays of sliders
+  // that run through the square. Called with +1 when the piece is placed
+  // and -1 when it is removed. Without kThroughRays the slider rays are
+  // left alone, for a capture, which takes a piece off a square and puts
+  // another on it.
+  template <int kDelta, bool kThroughRays = true>
+  void UpdateAttacksAround(const Piece& piece, int square);
+  void InitializeAttackCounts();
+  // SetPiece / RemovePiece without the piece list. With kUpdateState false
+  // only the mailbox and bitboards change: UndoMove restores the hash,
+  // material, positional sum, king locations and attack counts from state_stack_.
+  template <bool kUpdateState, bool kThroughRays = true>
+  void PlacePiece(const BoardLocation& location, const Piece& piece);
+  template <bool kUpdateState, bool kThroughRays = true>
+  void TakePiece(const BoardLocation& location);
+  void AddToPieceList(const BoardLocation& location, const Piece& piece) {
+    piece_index_[location.Square()] =
+      piece_list_[piece.GetColor()].Add(PlacedPiece(location, piece));
+  }
+  void RemoveFromPieceList(const BoardLocation& location, PlayerColor color) {
+    const PlacedPiece* moved =
+      piece_list_[color].RemoveAt(piece_index_[location.Square()]);
+    if (moved != nullptr) {
+      piece_index_[moved->GetLocation().Square()] =
+        piece_index_[location.Square()];
+    }
+  }
+  // Moves a piece (possibly promoted) within its slot, so that the order of
+  // the list survives MakeMove / UndoMove.
+  void MoveInPieceList(const BoardLocation& from, const BoardLocation& to,
+                       const Piece& piece) {
+    int index = piece_index_[from.Square()];
+    piece_list_[piece.GetColor()].Replace(index, PlacedPiece(to, piece));
+    piece_index_[to.Square()] = index;
+  }
+
   void InitializeHash();
   void UpdatePieceHash(const Piece& piece, const BoardLocation& loc) {
-    hash_key_ ^= piece_hashes_[piece.GetColor()][piece.GetPieceType()]
-      [loc.GetRow()][loc.GetCol()];
+    int64_t key = kZobristKeys.pieces[piece.GetColor()][piece.GetPieceType()]
+      [loc.Square()];
+    hash_key_ ^= key;
+    if (piece.GetPieceType() == PAWN || piece.GetPieceType() == KING) {
+      pawn_key_ ^= key;
+    }
   }
   void UpdateTurnHash(int turn) {
-    hash_key_ ^= turn_hashes_[turn];
+    hash_key_ ^= kZobristKeys.turns[turn];
+  }
+  static int64_t CastlingKey(PlayerColor color, const CastlingRights& rights) {
+    int64_t key = 0;
+    if (rights.Kingside()) {
+      key ^= kZobristKeys.castling[color][KINGSIDE];
+    }
+    if (rights.Queenside()) {
+      key ^= kZobristKeys.castling[color][QUEENSIDE];
+    }
+    return key;
+  }
+  void UpdateCastlingHash(PlayerColor color, const CastlingRights& rights) {
+    hash_key_ ^= CastlingKey(color, rights);
+  }
+  // En-passant key of a move: set if the moving piece is a pawn stepping
+  // two squares straight ahead, and an opponent's pawn can capture it en
+  // passant. Otherwise the position is the same as after single steps.
+  int64_t EnpassantKey(const Move& move, const Piece& piece) const;
+  // Replaces the en-passant key of the color in hash_key_.
+  void SetEnpassantKey(PlayerColor color, int64_t key) {
+    hash_key_ ^= enpassant_keys_[color] ^ key;
+    enpassant_keys_[color] = key;
   }
 
-  Player turn_;
-
-  Piece location_to_piece_[14][14];
-  std::vector<std::vector<PlacedPiece>> piece_list_;
-
-  BoardLocation locations_[14][14];
-
-  CastlingRights castling_rights_[4];
+  // State before each move in moves_, which UndoMove restores by copy. Only
+  // the mover's castling rights and en-passant key can change in a move.
+  struct StateInfo {
+    int64_t hash_key;
+    int64_t pawn_key;
+    int piece_evaluation;
+    int player_piece_evaluations[4];
+    int positional_evaluation;
+    BoardLocation king_locations[4];
+    CastlingRights castling_rights;
+    int64_t enpassant_key;
+    AttackCounts attack_counts;
+  };
+  // Reserved for kStateStackReserve moves so that the search does not
+  // reallocate it.
+  std::vector<StateInfo> state_stack_;
+
+  // En-passant moves before the first move in moves_.
   EnpassantInitialization enp_;
   std::vector<Move> moves_; // list of moves from beginning of game
-  std::vector<Move> move_buffer_;
-  int piece_evaluation_ = 0;
-  int player_piece_evaluations_[4] = {0, 0, 0, 0}; // one per player
-
-  int64_t hash_key_ = 0;
-  int64_t piece_hashes_[4][6][14][14];
-  int64_t turn_hashes_[4];
-  BoardLocation king_locations_[4];
-
-  size_t move_buffer_size_ = 300;
-  Move move_buffer_2_[300];
 };
 
 // Helper functions
@@ -1,4 +1,6 @@
+#include <algorithm>
 
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include <gtest/gtest.h>
@@ -1603,6 +1605,226 @@ Move MakeMove(const Board& board, BoardLocation from, BoardLocation to) {
 
 }  // namespace
 
+TEST(BoardTest, AttackCountsMatchAttackers) {
+  auto board = ParseBoardFromFEN("R-0,0,0,0-1,1,1,1-1,0,1,1-0,0,0,0-2-x,x,x,yR,yN,1,yK,1,yB,yN,yR,x,x,x/x,x,x,yP,yP,yP,1,yP,yP,yP,yP,x,x,x/x,x,x,3,yP,4,x,x,x/bR,bP,10,gP,gR/bN,bP,10,gP,gN/bB,2,bP,8,gP,1/bQ,bP,9,gP,1,gK/bK,bP,bP,1,yQ,7,gP,1/bB,11,gP,gB/bN,1,bP,6,gB,2,gP,gN/3,bR,1,rP,6,gP,gR/x,x,x,4,rP,3,x,x,x/x,x,x,rP,rP,1,rP,1,rP,rP,rP,x,x,x/x,x,x,rR,1,rB,rQ,rK,1,rN,rR,x,x,x");
+
+  auto expect_counts_match = [&board]() {
+    PlacedPiece attackers[40];
+    for (int row = 0; row < 14; row++) {
+      for (int col = 0; col < 14; col++) {
+        Loc loc(row, col);
+        if (!board->IsLegalLocation(loc)) {
+          continue;
+        }
+        for (Team team : {RED_YELLOW, BLUE_GREEN}) {
+          ASSERT_EQ(board->GetAttackCount(team, loc),
+                    (int)board->GetAttackers2(attackers, 40, team, loc))
+            << loc << " team " << team;
+        }
+      }
+    }
+  };
+
+  expect_counts_match();
+  Move moves[300];
+  int num_made = 0;
+  for (int ply = 0; ply < 60; ply++) {
+    size_t num_moves = board->GetPseudoLegalMoves2(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    // Prefer captures so that slider rays open and close.
+    size_t pick = (ply * 7) % num_moves;
+    for (size_t i = 0; i < num_moves; i++) {
+      if (moves[i].IsCapture()
+          && moves[i].GetCapturePiece().GetPieceType() != KING) {
+        pick = i;
+        break;
+      }
+    }
+    if (moves[pick].IsCapture()
+        && moves[pick].GetCapturePiece().GetPieceType() == KING) {
+      break;
+    }
+    board->MakeMove(moves[pick]);
+    num_made++;
+    expect_counts_match();
+  }
+  EXPECT_GT(num_made, 20);
+  for (int i = 0; i < num_made; i++) {
+    board->UndoMove();
+    expect_counts_match();
+  }
+}
+
+TEST(BoardTest, PieceListTracksBoard) {
+  auto board = Board::CreateStandardSetup();
+
+  auto expect_piece_list_matches = [&board]() {
+    int num_pieces = 0;
+    for (int color = 0; color < 4; color++) {
+      for (const auto& placed_piece : board->GetPieceList()[color]) {
+        ASSERT_EQ(board->GetPiece(placed_piece.GetLocation()),
+                  placed_piece.GetPiece());
+        ASSERT_EQ(placed_piece.GetPiece().GetColor(), color);
+        num_pieces++;
+      }
+    }
+    EXPECT_EQ(num_pieces, board->GetOccupiedBitboard().PopCount());
+  };
+  auto snapshot = [&board]() {
+    std::vector<std::pair<BoardLocation, Piece>> pieces;
+    for (int color = 0; color < 4; color++) {
+      for (const auto& placed_piece : board->GetPieceList()[color]) {
+        pieces.emplace_back(placed_piece.GetLocation(),
+                            placed_piece.GetPiece());
+      }
+    }
+    return pieces;
+  };
+
+  Move moves[300];
+  int num_made = 0;
+  for (int ply = 0; ply < 80; ply++) {
+    size_t num_moves = board->GetLegalMoves(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    // Making and undoing a quiet move keeps the order of the list.
+    for (size_t i = 0; i < num_moves; i++) {
+      if (!moves[i].IsCapture()) {
+        auto before = snapshot();
+        board->MakeMove(moves[i]);
+        expect_piece_list_matches();
+        board->UndoMove();
+        EXPECT_EQ(snapshot(), before);
+        break;
+      }
+    }
+    // Prefer captures so that pieces leave the lists.
+    size_t pick = (ply * 7) % num_moves;
+    for (size_t i = 0; i < num_moves; i++) {
+      if (moves[i].IsCapture()) {
+        pick = i;
+        break;
+      }
+    }
+    board->MakeMove(moves[pick]);
+    num_made++;
+    expect_piece_list_matches();
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+  EXPECT_GT(num_made, 20);
+  for (int i = 0; i < num_made; i++) {
+    board->UndoMove();
+    expect_piece_list_matches();
+  }
+}
+
+TEST(BoardTest, LegalMovesMatchMakeUndoFiltering) {
+  auto board = ParseBoardFromFEN("R-0,0,0,0-1,1,1,1-1,0,1,1-0,0,0,0-2-x,x,x,yR,yN,1,yK,1,yB,yN,yR,x,x,x/x,x,x,yP,yP,yP,1,yP,yP,yP,yP,x,x,x/x,x,x,3,yP,4,x,x,x/bR,bP,10,gP,gR/bN,bP,10,gP,gN/bB,2,bP,8,gP,1/bQ,bP,9,gP,1,gK/bK,bP,bP,1,yQ,7,gP,1/bB,11,gP,gB/bN,1,bP,6,gB,2,gP,gN/3,bR,1,rP,6,gP,gR/x,x,x,4,rP,3,x,x,x/x,x,x,rP,rP,1,rP,1,rP,rP,rP,x,x,x/x,x,x,rR,1,rB,rQ,rK,1,rN,rR,x,x,x");
+
+  Move pseudo_legal[300];
+  Move legal[300];
+  int num_checks = 0;
+  for (int ply = 0; ply < 80; ply++) {
+    Player player = board->GetTurn();
+    size_t num_pseudo_legal = board->GetPseudoLegalMoves2(pseudo_legal, 300);
+    std::vector<Move> expected;
+    for (size_t i = 0; i < num_pseudo_legal; i++) {
+      const auto& move = pseudo_legal[i];
+      bool is_legal = board->IsLegalMove(move);
+      board->MakeMove(move);
+      if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS
+          || !board->IsKingInCheck(player)) {
+        expected.push_back(move);
+      }
+      board->UndoMove();
+      EXPECT_EQ(is_legal, expected.size() > 0 && expected.back() == move)
+        << move;
+    }
+
+    num_checks += board->IsKingInCheck(player);
+    size_t num_legal = board->GetLegalMoves(legal, 300);
+    ASSERT_EQ(num_legal, expected.size()) << *board;
+    for (const auto& move : expected) {
+      EXPECT_NE(std::find(legal, legal + num_legal, move), legal + num_legal)
+        << move;
+    }
+
+    // The captures and the quiet moves split the legal moves.
+    Move captures[300];
+    Move quiets[300];
+    size_t num_captures = board->GetLegalMoves(captures, 300, CAPTURES);
+    size_t num_quiets = board->GetLegalMoves(quiets, 300, QUIETS);
+    EXPECT_EQ(num_captures + num_quiets, num_legal);
+    for (size_t i = 0; i < num_captures; i++) {
+      EXPECT_TRUE(captures[i].IsCapture()) << captures[i];
+      EXPECT_NE(std::find(legal, legal + num_legal, captures[i]),
+                legal + num_legal) << captures[i];
+    }
+    for (size_t i = 0; i < num_quiets; i++) {
+      EXPECT_FALSE(quiets[i].IsCapture()) << quiets[i];
+      EXPECT_NE(std::find(legal, legal + num_legal, quiets[i]),
+                legal + num_legal) << quiets[i];
+    }
+
+    if (expected.empty()) {
+      break;
+    }
+    // Prefer captures and checks so that pins and evasions come up.
+    const Move* pick = &expected[(ply * 7) % expected.size()];
+    for (auto& move : expected) {
+      if (move.IsCapture() || move.DeliversCheck(*board)) {
+        pick = &move;
+        break;
+      }
+    }
+    board->MakeMove(*pick);
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+  EXPECT_GT(num_checks, 0);
+}
+
+TEST(BoardTest, PackedMoveRoundTrip) {
+  EXPECT_EQ(sizeof(PackedMove), 4);
+  EXPECT_FALSE(PackedMove().Present());
+  EXPECT_FALSE(PackedMove(Move()).Present());
+
+  auto board = Board::CreateStandardSetup();
+  Move moves[300];
+  for (int ply = 0; ply < 120; ply++) {
+    size_t num_moves = board->GetPseudoLegalMoves2(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    for (size_t i = 0; i < num_moves; i++) {
+      PackedMove packed(moves[i]);
+      EXPECT_EQ(packed.From(), moves[i].From().Square());
+      EXPECT_EQ(packed.To(), moves[i].To().Square());
+      EXPECT_EQ(packed.GetPromotionPieceType(),
+                moves[i].GetPromotionPieceType());
+      auto unpacked = board->UnpackMove(packed);
+      ASSERT_TRUE(unpacked.has_value()) << moves[i];
+      EXPECT_EQ(*unpacked, moves[i]);
+    }
+    const Move& move = moves[(ply * 13) % num_moves];
+    if (move.IsCapture() && move.GetCapturePiece().GetPieceType() == KING) {
+      break;
+    }
+    board->MakeMove(move);
+  }
+
+  // A move of a piece that is not on the board does not unpack.
+  board = Board::CreateStandardSetup();
+  EXPECT_FALSE(board->UnpackMove(PackedMove(
+          Move(BoardLocation(7, 7), BoardLocation(6, 7)))).has_value());
+}
+
 TEST(BoardTest, DeliversCheck) {
   auto board = ParseBoardFromFEN("R-0,0,0,0-1,1,1,1-1,1,1,1-0,0,0,0-0-x,x,x,yR,yN,yB,yK,yQ,yB,yN,yR,x,x,x/x,x,x,yP,yP,yP,1,yP,yP,yP,yP,x,x,x/x,x,x,3,yP,4,x,x,x/bR,bP,10,gP,gR/bN,bP,10,gP,gN/bB,bP,10,gP,gB/bQ,bP,9,gP,1,gK/bK,1,bP,9,gP,gQ/bB,bP,10,gP,gB/bN,bP,10,gP,gN/bR,bP,10,gP,gR/x,x,x,4,rP,3,x,x,x/x,x,x,rP,rP,rP,rP,1,rP,rP,rP,x,x,x/x,x,x,rR,rN,rB,rQ,rK,rB,rN,rR,x,x,x");
 
@@ -1690,6 +1912,432 @@ TEST(BoardTest, Promotions) {
 }
 
 
+TEST(BoardTest, KeyTest_CastlingAndEnpassant) {
+  // Blue's last move was the pawn double step to d8, which the yellow pawn
+  // on d9 can capture en passant.
+  const std::string placement = "x,x,x,1,yN,1,yK,2,yN,yR,x,x,x/x,x,x,1,yP,yP,3,yP,yP,x,x,x/x,x,x,3,yP,1,yP,2,x,x,x/bR,bP,5,yP,4,gP,gR/1,bP,10,gP,gN/bB,bP,1,yP,8,gP,1/bK,2,bP,7,gP,1,gK/4,rR,7,gP,1/11,gP,2/1,bP,1,yP,9,gN/1,bP,8,gP,1,gP,gR/x,x,x,rP,1,rN,1,rP,gB,2,x,x,x/x,x,x,2,rP,rP,1,rP,2,x,x,x/x,x,x,4,rK,3,x,x,x";
+  auto board = ParseBoardFromFEN(
+      "Y-0,0,0,0-0,0,0,1-0,0,1,1-0,0,0,0-0-{'enPassant':('','c8:d8','','')}-"
+      + placement);
+  auto no_castling = ParseBoardFromFEN(
+      "Y-0,0,0,0-0,0,0,0-0,0,1,1-0,0,0,0-0-{'enPassant':('','c8:d8','','')}-"
+      + placement);
+  auto no_enpassant = ParseBoardFromFEN(
+      "Y-0,0,0,0-0,0,0,1-0,0,1,1-0,0,0,0-0-" + placement);
+  ASSERT_NE(board, nullptr);
+  ASSERT_NE(no_castling, nullptr);
+  ASSERT_NE(no_enpassant, nullptr);
+
+  // Same pieces and turn, different castling or en-passant state.
+  EXPECT_NE(board->HashKey(), no_castling->HashKey());
+  EXPECT_NE(board->HashKey(), no_enpassant->HashKey());
+
+  // The keys do not depend on the board instance.
+  EXPECT_EQ(Board::CreateStandardSetup()->HashKey(),
+            Board::CreateStandardSetup()->HashKey());
+  Board copy = *board;
+  EXPECT_EQ(copy.HashKey(), board->HashKey());
+
+  // Without the yellow pawn, the double step could not be captured and
+  // leaves no en-passant key.
+  const std::string quiet_placement = "x,x,x,1,yN,1,yK,2,yN,yR,x,x,x/x,x,x,1,yP,yP,3,yP,yP,x,x,x/x,x,x,3,yP,1,yP,2,x,x,x/bR,bP,5,yP,4,gP,gR/1,bP,10,gP,gN/bB,bP,10,gP,1/bK,2,bP,7,gP,1,gK/4,rR,7,gP,1/11,gP,2/1,bP,1,yP,9,gN/1,bP,8,gP,1,gP,gR/x,x,x,rP,1,rN,1,rP,gB,2,x,x,x/x,x,x,2,rP,rP,1,rP,2,x,x,x/x,x,x,4,rK,3,x,x,x";
+  auto quiet = ParseBoardFromFEN(
+      "Y-0,0,0,0-0,0,0,1-0,0,1,1-0,0,0,0-0-{'enPassant':('','c8:d8','','')}-"
+      + quiet_placement);
+  auto quiet_no_enpassant = ParseBoardFromFEN(
+      "Y-0,0,0,0-0,0,0,1-0,0,1,1-0,0,0,0-0-" + quiet_placement);
+  ASSERT_NE(quiet, nullptr);
+  ASSERT_NE(quiet_no_enpassant, nullptr);
+  EXPECT_EQ(quiet->HashKey(), quiet_no_enpassant->HashKey());
+
+  // A double step next to an opponent's pawn adds an en-passant key, which
+  // the same position reached by single steps does not have.
+  auto double_step = Board::CreateStandardSetup();
+  auto single_step = Board::CreateStandardSetup();
+  for (auto* b : {double_step.get(), single_step.get()}) {
+    // A blue pawn to the square next to the red pawn's target square.
+    for (int col = 1; col < 6; col++) {
+      b->MakeNullMove();
+      b->MakeMove(Move(BoardLocation(10, col), BoardLocation(10, col + 1)));
+      b->MakeNullMove();
+      b->MakeNullMove();
+    }
+  }
+  int64_t h0 = double_step->HashKey();
+  double_step->MakeMove(Move(BoardLocation(12, 7), BoardLocation(10, 7)));
+  single_step->MakeMove(Move(BoardLocation(12, 7), BoardLocation(11, 7)));
+  single_step->MakeNullMove();
+  single_step->MakeNullMove();
+  single_step->MakeNullMove();
+  single_step->MakeMove(Move(BoardLocation(11, 7), BoardLocation(10, 7)));
+  EXPECT_NE(double_step->HashKey(), single_step->HashKey());
+  double_step->UndoMove();
+  EXPECT_EQ(h0, double_step->HashKey());
+
+  // Without one, both move orders reach the same key.
+  double_step = Board::CreateStandardSetup();
+  single_step = Board::CreateStandardSetup();
+  double_step->MakeMove(Move(BoardLocation(12, 7), BoardLocation(10, 7)));
+  single_step->MakeMove(Move(BoardLocation(12, 7), BoardLocation(11, 7)));
+  single_step->MakeNullMove();
+  single_step->MakeNullMove();
+  single_step->MakeNullMove();
+  single_step->MakeMove(Move(BoardLocation(11, 7), BoardLocation(10, 7)));
+  EXPECT_EQ(double_step->HashKey(), single_step->HashKey());
+
+  // Losing castling rights changes the key, and undo restores it.
+  auto castling = Board::CreateStandardSetup();
+  castling->MakeMove(Move(BoardLocation(12, 8), BoardLocation(11, 8)));
+  castling->MakeNullMove();
+  castling->MakeNullMove();
+  castling->MakeNullMove();
+  int64_t h1 = castling->HashKey();
+  Move moves[300];
+  size_t num_moves = castling->GetLegalMoves(moves, 300);
+  auto it = std::find_if(moves, moves + num_moves, [](const Move& move) {
+    return move.From() == BoardLocation(13, 7)
+        && move.To() == BoardLocation(12, 8);
+  });
+  ASSERT_NE(it, moves + num_moves);
+  ASSERT_TRUE(it->GetCastlingRights().Present());
+  castling->MakeMove(*it);
+  castling->MakeMove(Move(BoardLocation(7, 1), BoardLocation(7, 2)));
+  castling->MakeMove(Move(BoardLocation(1, 6), BoardLocation(2, 6)));
+  castling->MakeMove(Move(BoardLocation(6, 12), BoardLocation(6, 11)));
+  castling->MakeMove(Move(BoardLocation(12, 8), BoardLocation(13, 7)));
+  castling->MakeMove(Move(BoardLocation(7, 2), BoardLocation(7, 1)));
+  castling->MakeMove(Move(BoardLocation(2, 6), BoardLocation(1, 6)));
+  castling->MakeMove(Move(BoardLocation(6, 11), BoardLocation(6, 12)));
+  EXPECT_NE(h1, castling->HashKey());
+  for (int i = 0; i < 8; i++) {
+    castling->UndoMove();
+  }
+  EXPECT_EQ(h1, castling->HashKey());
+}
+
+TEST(BoardTest, UndoRestoresState) {
+  auto board = Board::CreateStandardSetup();
+  Move moves[300];
+  std::vector<int64_t> hashes;
+  std::vector<int> evaluations;
+  std::vector<BoardLocation> red_kings;
+  for (int ply = 0; ply < 100; ply++) {
+    size_t num_moves = board->GetLegalMoves(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    // Prefer captures so that material changes.
+    const Move* pick = &moves[(ply * 11) % num_moves];
+    for (size_t i = 0; i < num_moves; i++) {
+      if (moves[i].IsCapture()) {
+        pick = &moves[i];
+        break;
+      }
+    }
+    hashes.push_back(board->HashKey());
+    evaluations.push_back(board->PieceEvaluation());
+    red_kings.push_back(board->GetKingLocation(RED));
+    board->MakeMove(*pick);
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+  ASSERT_EQ(board->NumMoves(), (int)hashes.size());
+  for (size_t i = 0; i < hashes.size(); i++) {
+    EXPECT_EQ(board->HashKeyBeforeMove(i), hashes[i]);
+  }
+
+  while (!hashes.empty()) {
+    board->UndoMove();
+    EXPECT_EQ(board->HashKey(), hashes.back());
+    EXPECT_EQ(board->PieceEvaluation(), evaluations.back());
+    EXPECT_EQ(board->GetKingLocation(RED), red_kings.back());
+    hashes.pop_back();
+    evaluations.pop_back();
+    red_kings.pop_back();
+  }
+  EXPECT_EQ(board->HashKey(), Board::CreateStandardSetup()->HashKey());
+}
+
+TEST(BoardTest, PositionalEvaluationIsIncremental) {
+  auto table = std::make_unique<PieceSquareTable>();
+  for (int color = 0; color < 4; color++) {
+    for (int piece_type = 0; piece_type < 6; piece_type++) {
+      for (int square = 0; square < kNumSquares; square++) {
+        table->values[color][piece_type][square] =
+          (square * 7 + piece_type * 13 + color * 31) % 50 - 25;
+      }
+    }
+  }
+
+  auto board = Board::CreateStandardSetup();
+  board->SetPieceSquareTable(table.get());
+  Move moves[300];
+  std::vector<int> evaluations;
+  for (int ply = 0; ply < 100; ply++) {
+    size_t num_moves = board->GetLegalMoves(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    evaluations.push_back(board->PositionalEvaluation());
+    board->MakeMove(moves[(ply * 11) % num_moves]);
+
+    // Matches the sum over a copy that recomputes it from scratch.
+    Board copy = *board;
+    copy.SetPieceSquareTable(table.get());
+    EXPECT_EQ(board->PositionalEvaluation(), copy.PositionalEvaluation());
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+
+  while (!evaluations.empty()) {
+    board->UndoMove();
+    EXPECT_EQ(board->PositionalEvaluation(), evaluations.back());
+    evaluations.pop_back();
+  }
+
+  board->SetPieceSquareTable(nullptr);
+  EXPECT_EQ(board->PositionalEvaluation(), 0);
+}
+
+TEST(BoardTest, PawnKeyTracksPawnsAndKings) {
+  auto board = Board::CreateStandardSetup();
+  int64_t start_key = board->PawnKey();
+  EXPECT_NE(start_key, 0);
+
+  // A knight move leaves the pawn key alone.
+  board->MakeMove(Move(BoardLocation(13, 4), BoardLocation(11, 5)));
+  EXPECT_EQ(board->PawnKey(), start_key);
+  EXPECT_NE(board->HashKey(), Board::CreateStandardSetup()->HashKey());
+
+  // A pawn move changes it, and undo restores it.
+  board->MakeMove(Move(BoardLocation(6, 1), BoardLocation(6, 3)));
+  EXPECT_NE(board->PawnKey(), start_key);
+  board->UndoMove();
+  EXPECT_EQ(board->PawnKey(), start_key);
+  board->UndoMove();
+  EXPECT_EQ(board->PawnKey(), start_key);
+}
+
+TEST(BoardTest, StaticExchangeEvaluation) {
+  // Red queen takes a blue pawn defended by a blue rook.
+  std::unordered_map<BoardLocation, Piece> location_to_piece = {
+    {BoardLocation(13, 7), Piece(RED, KING)},
+    {BoardLocation(7, 0), Piece(BLUE, KING)},
+    {BoardLocation(0, 7), Piece(YELLOW, KING)},
+    {BoardLocation(6, 13), Piece(GREEN, KING)},
+    {BoardLocation(10, 6), Piece(RED, QUEEN)},
+    {BoardLocation(6, 6), Piece(BLUE, PAWN)},
+    {BoardLocation(6, 2), Piece(BLUE, ROOK)},
+  };
+  Board board(Player(RED), location_to_piece);
+  Move qxp(BoardLocation(10, 6), BoardLocation(6, 6),
+           Piece(BLUE, PAWN));
+  EXPECT_EQ(board.StaticExchangeEvaluation(qxp, kPieceEvaluations),
+            kPieceEvaluations[PAWN] - kPieceEvaluations[QUEEN]);
+
+  // A yellow rook behind the red queen recaptures as an x-ray.
+  location_to_piece[BoardLocation(11, 6)] = Piece(YELLOW, ROOK);
+  Board xray(Player(RED), location_to_piece);
+  EXPECT_EQ(xray.StaticExchangeEvaluation(qxp, kPieceEvaluations),
+            kPieceEvaluations[PAWN] - kPieceEvaluations[QUEEN]
+            + kPieceEvaluations[ROOK]);
+  EXPECT_EQ(StaticExchangeEvaluationCapture(kPieceEvaluations, xray, qxp),
+            xray.StaticExchangeEvaluation(qxp, kPieceEvaluations));
+}
+
+TEST(BoardTest, StaticExchangeEvaluationGeMatchesValue) {
+  auto board = Board::CreateStandardSetup();
+  Move moves[300];
+  int num_captures = 0;
+  for (int ply = 0; ply < 200; ply++) {
+    size_t num_moves = board->GetLegalMoves(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    for (size_t i = 0; i < num_moves; i++) {
+      if (!moves[i].IsCapture()) {
+        continue;
+      }
+      num_captures++;
+      int see = board->StaticExchangeEvaluation(moves[i], kPieceEvaluations);
+      for (int threshold : {-1000, -500, -1, 0, 1, 100, 250, see, see + 1}) {
+        EXPECT_EQ(board->StaticExchangeEvaluationGe(
+                      moves[i], threshold, kPieceEvaluations),
+                  see >= threshold);
+      }
+    }
+    board->MakeMove(moves[(ply * 7) % num_moves]);
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+  EXPECT_GT(num_captures, 0);
+}
+
+TEST(BoardTest, DeliversCheckMatchesNewAttackers) {
+  // Squares of the pieces of `team`, other than kings, that attack the
+  // location.
+  auto attacker_squares = [](const Board& board, Team team,
+                             const BoardLocation& location) {
+    PlacedPiece attackers[32];
+    size_t num_attackers = board.GetAttackers2(attackers, 32, team, location);
+    Bitboard squares;
+    for (size_t i = 0; i < num_attackers; i++) {
+      if (attackers[i].GetPiece().GetPieceType() != KING) {
+        squares.Set(attackers[i].GetLocation().Square());
+      }
+    }
+    return squares;
+  };
+
+  auto board = Board::CreateStandardSetup();
+  Move moves[300];
+  int num_checks = 0;
+  int num_discovered = 0;
+  int num_direct_only_missed = 0;
+  for (int ply = 0; ply < 300; ply++) {
+    size_t num_moves = board->GetLegalMoves(moves, 300);
+    if (num_moves == 0) {
+      break;
+    }
+    const Player player = board->GetTurn();
+    const CheckInfo check_info = board->GetCheckInfo();
+    const CheckInfo direct_check_info = board->GetCheckInfo(false);
+    for (size_t i = 0; i < num_moves; i++) {
+      const Move& move = moves[i];
+      // Expected: the king is captured, or the team attacks it from a
+      // square it did not attack it from before.
+      bool expected = false;
+      bool discovered = false;
+      for (int add = 1; add < 4; add += 2) {
+        PlayerColor other = static_cast<PlayerColor>(
+            (player.GetColor() + add) % 4);
+        BoardLocation king_location = board->GetKingLocation(other);
+        if (!king_location.Present()) {
+          continue;
+        }
+        Bitboard before =
+          attacker_squares(*board, player.GetTeam(), king_location);
+        board->MakeMove(move);
+        Bitboard after = king_location == move.To()
+          ? ~Bitboard()
+          : attacker_squares(*board, player.GetTeam(), king_location);
+        board->UndoMove();
+        Bitboard new_attackers = after.AndNot(before);
+        expected |= new_attackers.Any();
+        new_attackers.Clear(move.To().Square());
+        discovered |= new_attackers.Any() && king_location != move.To();
+      }
+      EXPECT_EQ(board->DeliversCheck(move, check_info), expected)
+        << move << *board;
+      // Direct checks only: never a check that is not there.
+      bool direct = board->DeliversCheck(move, direct_check_info);
+      EXPECT_TRUE(!direct || expected) << move << *board;
+      num_direct_only_missed += expected && !direct;
+      num_checks += expected;
+      num_discovered += discovered;
+    }
+    board->MakeMove(moves[(ply * 7) % num_moves]);
+    if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+      break;
+    }
+  }
+  EXPECT_GT(num_checks, 0);
+  EXPECT_GT(num_discovered, 0);
+  EXPECT_GT(num_direct_only_missed, 0);
+}
+
+TEST(BoardTest, BoardFromPositionMatchesOriginal) {
+  auto board = Board::CreateStandardSetup();
+  // A blue pawn to the square next to the red pawn's target square.
+  for (int col = 1; col < 6; col++) {
+    board->MakeNullMove();
+    board->MakeMove(Move(BoardLocation(10, col), BoardLocation(10, col + 1)));
+    board->MakeNullMove();
+    board->MakeNullMove();
+  }
+  board->MakeMove(Move(BoardLocation(12, 7), BoardLocation(10, 7)));
+
+  Board copy(board->GetPosition());
+  EXPECT_EQ(copy.HashKey(), board->HashKey());
+  EXPECT_EQ(copy.PawnKey(), board->PawnKey());
+  EXPECT_EQ(copy.GetTurn(), board->GetTurn());
+
+  // Red's double step is still an en-passant target.
+  const auto& enp = copy.GetEnpassantInitialization();
+  ASSERT_TRUE(enp.enp_moves[RED].has_value());
+  EXPECT_EQ(enp.enp_moves[RED]->From(), BoardLocation(12, 7));
+  EXPECT_EQ(enp.enp_moves[RED]->To(), BoardLocation(10, 7));
+  EXPECT_FALSE(enp.enp_moves[BLUE].has_value());
+  EXPECT_FALSE(enp.enp_moves[YELLOW].has_value());
+  EXPECT_FALSE(enp.enp_moves[GREEN].has_value());
+
+  Move expected[300];
+  Move actual[300];
+  size_t num_expected = board->GetLegalMoves(expected, 300);
+  size_t num_actual = copy.GetLegalMoves(actual, 300);
+  ASSERT_EQ(num_actual, num_expected);
+  int num_enpassant = 0;
+  for (size_t i = 0; i < num_expected; i++) {
+    EXPECT_EQ(actual[i], expected[i]);
+    num_enpassant += expected[i].GetEnpassantLocation().Present();
+  }
+  EXPECT_EQ(num_enpassant, 1);
+}
+
+TEST(BoardTest, HashKeyAfterMatchesMakeMove) {
+  Move moves[300];
+  int num_enpassant = 0;
+  int num_castling = 0;
+  int num_promotions = 0;
+  auto check_moves = [&](Board& board) {
+    size_t num_moves = board.GetPseudoLegalMoves2(moves, 300);
+    for (size_t i = 0; i < num_moves; i++) {
+      const Move& move = moves[i];
+      int64_t expected_key = board.HashKeyAfter(move);
+      board.MakeMove(move);
+      EXPECT_EQ(board.HashKey(), expected_key) << move;
+      board.UndoMove();
+      num_enpassant += move.GetEnpassantLocation().Present();
+      num_castling += move.GetRookMove().Present();
+      num_promotions += move.GetPromotionPieceType() != NO_PIECE;
+    }
+    return num_moves;
+  };
+
+  for (int step : {7, 13}) {
+    auto board = Board::CreateStandardSetup();
+    for (int ply = 0; ply < 400; ply++) {
+      size_t num_moves = check_moves(*board);
+      if (num_moves == 0) {
+        break;
+      }
+      board->MakeMove(moves[(ply * step) % num_moves]);
+      if (board->CheckWasLastMoveKingCapture() != IN_PROGRESS) {
+        break;
+      }
+    }
+  }
+
+  // Promotions, with and without a capture.
+  std::unordered_map<BoardLocation, Piece> location_to_piece = {
+    {BoardLocation(13, 7), Piece(RED, KING)},
+    {BoardLocation(4, 5), Piece(RED, PAWN)},
+    {BoardLocation(3, 6), Piece(YELLOW, KNIGHT)},
+    {BoardLocation(0, 7), Piece(YELLOW, KING)},
+    {BoardLocation(7, 0), Piece(BLUE, KING)},
+    {BoardLocation(6, 13), Piece(GREEN, KING)},
+  };
+  Board promotion_board(Player(RED), location_to_piece);
+  check_moves(promotion_board);
+
+  EXPECT_GT(num_enpassant, 0);
+  EXPECT_GT(num_castling, 0);
+  EXPECT_GT(num_promotions, 0);
+}
+
 }  // namespace chess
 
 
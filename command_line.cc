@@ -12,6 +12,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "perft.h"
 #include "player.h"
 #include "transposition_table.h"
 #include "board.h"
@@ -233,6 +234,10 @@ void CommandLine::HandleCommand(
     // Allowed options
     std::cout << "option name Hash type spin default 100"
       << std::endl; // size in MB
+    std::cout << "option name HashFile type string default none"
+      << std::endl;
+    std::cout << "option name SharedHash type string default none"
+      << std::endl;
     std::cout << "option name UCI_ShowCurrLine type check default false"
       << std::endl;
 
@@ -267,7 +272,7 @@ void CommandLine::HandleCommand(
               "Hash MB must be non-negative, given: " + option_value);
           return;
         }
-        size_t size = *val * 1000000 / sizeof(HashTableEntry);
+        size_t size = *val * 1000000 / sizeof(HashTableSlot);
         if (size != player_options_.transposition_table_size) {
           player_options_.transposition_table_size = size;
           player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
@@ -276,6 +281,29 @@ void CommandLine::HandleCommand(
         SendInvalidCommandMessage("Can not parse int: " + option_value);
         return;
       }
+    } else if (option_name == "hashfile") {
+      // Maps the transposition table from the file, which keeps it across
+      // restarts. "none" keeps it in memory.
+      std::optional<std::string> path;
+      if (LowerCase(option_value) != "none") {
+        path = option_value;
+      }
+      if (path != player_options_.transposition_table_file) {
+        player_options_.transposition_table_file = path;
+        player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
+      }
+    } else if (option_name == "sharedhash") {
+      // Maps the transposition table from the named shared memory segment,
+      // shared with the other engine processes that use the same name and
+      // Hash size. "none" keeps it private.
+      std::optional<std::string> name;
+      if (LowerCase(option_value) != "none") {
+        name = option_value;
+      }
+      if (name != player_options_.transposition_table_shared_memory) {
+        player_options_.transposition_table_shared_memory = name;
+        player_ = std::make_shared<AlphaBetaPlayer>(player_options_);
+      }
     } else if (option_name == "uci_showcurrline") {
       if (option_value == "true") {
         show_current_line_ = true;
@@ -332,11 +360,85 @@ void CommandLine::HandleCommand(
     int n_legal = player_->GetNumLegalMoves(*board_);
     SendInfoMessage("n_legal " + std::to_string(n_legal));
 
+  } else if (command == "perft") {
+    // perft <depth>: leaf counts below each root move, then the total.
+    if (parts.size() != 2) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    auto depth = ParseInt(parts[1]);
+    if (!depth.has_value() || *depth < 1) {
+      SendInvalidCommandMessage("Invalid perft depth: " + parts[1]);
+      return;
+    }
+    StopEvaluation();
+    PerftOptions options;
+    options.num_threads = player_options_.num_threads;
+    auto start = system_clock::now();
+    PerftResult result = Perft(*board_, *depth, options);
+    auto duration_ms = duration_cast<milliseconds>(
+        system_clock::now() - start).count();
+    for (const auto& [move, count] : result.divide) {
+      std::cout << move.PrettyStr() << ": " << count << std::endl;
+    }
+    std::cout << "Nodes searched: " << result.nodes << std::endl;
+    SendInfoMessage("time " + std::to_string(duration_ms)
+        + " nps " + std::to_string(
+          duration_ms > 0 ? result.nodes * 1000 / duration_ms : 0));
+
+  } else if (command == "ttsave" || command == "ttload") {
+    if (parts.size() != 2) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    StopEvaluation();
+    std::lock_guard lock(mutex_);
+    const std::string& path = parts[1];
+    bool ok = command == "ttsave"
+      ? player_->SaveTranspositionTable(path)
+      : player_->LoadTranspositionTable(path);
+    if (ok) {
+      SendInfoMessage(command + " " + path + " done");
+    } else if (command == "ttsave") {
+      SendInfoMessage("Can not save transposition table to " + path);
+    } else {
+      SendInfoMessage("Can not load transposition table from " + path
+          + " (missing, saved with another Hash size or version, or the"
+          " table is a HashFile or SharedHash)");
+    }
+
+  } else if (command == "ttunlink") {
+    // Removes the SharedHash segment, or the named one, e.g. to free its
+    // memory or to start over with another Hash size. Processes that have
+    // it mapped keep using it.
+    std::optional<std::string> name =
+      player_options_.transposition_table_shared_memory;
+    if (parts.size() == 2) {
+      name = parts[1];
+    } else if (parts.size() != 1) {
+      SendInvalidCommandMessage(line);
+      return;
+    }
+    if (!name.has_value()) {
+      SendInfoMessage("No SharedHash segment to remove");
+    } else if (TranspositionTable::RemoveSharedMemory(*name)) {
+      SendInfoMessage(command + " " + *name + " done");
+    } else {
+      SendInfoMessage("Can not remove shared memory segment " + *name);
+    }
+
   } else if (command == "register") {
     // ignore
   } else if (command == "ucinewgame") {
-    // stop evaluation, if any, and create a new player / board
+    // stop evaluation, if any, clear the hash table (or age a shared one)
+    // and reset the board
     StopEvaluation();
+    {
+      std::lock_guard lock(mutex_);
+      if (player_ != nullptr) {
+        player_->ClearTranspositionTable();
+      }
+    }
     ResetBoard();
   } else if (command == "position") {
 
@@ -15,8 +15,9 @@ enum Stage {
 
 MovePicker::MovePicker(
     Board& board,
+    const CheckInfo& check_info,
     const std::optional<Move>& pvmove,
-    Move* killers,
+    PackedMove* killers,
     const int piece_evaluations[6],
     int history_heuristic[6][14][14][14][14],
     int capture_heuristic[6][4][6][4][14][14],
@@ -24,99 +25,195 @@ MovePicker::MovePicker(
     bool enable_move_order_checks,
     Move* buffer,
     size_t buffer_size
-    ,Move* counter_moves
+    ,PackedMove* counter_moves
     ,bool include_quiets
     ,const PieceToHistory** piece_to_history
     ) {
+  // Moves are generated stage by stage in GetNextMove, so that a cutoff on
+  // the PV move or an early capture never pays for the quiet moves.
+  board_ = &board;
+  check_info_ = &check_info;
+  pvmove_ = pvmove;
+  killers_ = killers;
+  piece_evaluations_ = piece_evaluations;
+  history_heuristic_ = history_heuristic;
+  capture_heuristic_ = capture_heuristic;
+  piece_move_order_scores_ = piece_move_order_scores;
+  counter_moves_ = counter_moves;
+  piece_to_history_ = piece_to_history;
+  include_quiets_ = include_quiets;
   enable_move_order_checks_ = enable_move_order_checks;
   stages_.resize(5);
   moves_ = buffer;
-  num_moves_ = board.GetPseudoLegalMoves2(buffer, buffer_size);
-  board_ = &board;
+  buffer_size_ = buffer_size;
+}
+
+bool MovePicker::IsPicked(const Move& move) const {
+  const PackedMove packed_move(move);
+  for (int i = 0; i < num_picked_; i++) {
+    if (picked_[i] == packed_move) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  for (size_t i = 0; i < num_moves_; i++) {
+void MovePicker::ScoreCaptures(size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
     auto& move = moves_[i];
+    if (IsPicked(move)) {
+      continue;
+    }
 
     const auto capture = move.GetCapturePiece();
-    const auto piece = board.GetPiece(move.From());
+    const auto piece = board_->GetPiece(move.From());
+    const auto& to = move.To();
+
+    int score = piece_move_order_scores_[piece.GetPieceType()];
+    int captured_val = piece_evaluations_[capture.GetPieceType()];
+    int attacker_val = piece_evaluations_[piece.GetPieceType()];
+    int incr_score = captured_val - attacker_val/100;
+    score += incr_score;
+    int history_score = capture_heuristic_[piece.GetPieceType()][piece.GetColor()]
+      [capture.GetPieceType()][capture.GetColor()]
+      [to.GetRow()][to.GetCol()];
+    score += history_score;
+    if (attacker_val <= captured_val) {
+      stages_[GOOD_CAPTURE].emplace_back(i, score);
+    } else {
+      stages_[BAD_CAPTURE].emplace_back(i, score);
+    }
+  }
+}
+
+void MovePicker::ScoreQuiets(size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    auto& move = moves_[i];
+    if (IsPicked(move)) {
+      continue;
+    }
+
+    const auto piece = board_->GetPiece(move.From());
     const auto piece_type = piece.GetPieceType();
     const auto& from = move.From();
     const auto& to = move.To();
 
-    int score = piece_move_order_scores[piece.GetPieceType()];
-    if (pvmove.has_value() && move == *pvmove) {
-      stages_[PV_MOVE].emplace_back(i, score);
-    } else if (killers != nullptr
-               && (killers[0] == move || killers[1] == move)
-               && include_quiets) {
-      stages_[KILLER].emplace_back(i, score + (move == killers[0] ? 1 : 0));
-    } else if (move.IsCapture()) {
-      int captured_val = piece_evaluations[capture.GetPieceType()];
-      int attacker_val = piece_evaluations[piece.GetPieceType()];
-      int incr_score = captured_val - attacker_val/100;
-      score += incr_score;
-      int history_score = capture_heuristic[piece.GetPieceType()][piece.GetColor()]
-        [capture.GetPieceType()][capture.GetColor()]
-        [to.GetRow()][to.GetCol()];
-      score += history_score;
-      if (attacker_val <= captured_val) {
-        stages_[GOOD_CAPTURE].emplace_back(i, score);
-      } else {
-        stages_[BAD_CAPTURE].emplace_back(i, score);
-      }
-    } else if (include_quiets) {
-      score += history_heuristic[piece.GetPieceType()][from.GetRow()][from.GetCol()][to.GetRow()][to.GetCol()] / 2;
-      if (move == counter_moves[from.GetRow()*14*14*14 + from.GetCol()*14*14
-          + to.GetRow()*14 + to.GetCol()]) {
-        score += 50;
-      }
-      score += (*piece_to_history[0])[piece_type][to.GetRow()][to.GetCol()] / 2;
-      score += (*piece_to_history[1])[piece_type][to.GetRow()][to.GetCol()] / 4;
-      score += (*piece_to_history[2])[piece_type][to.GetRow()][to.GetCol()] / 4;
-      score += (*piece_to_history[3])[piece_type][to.GetRow()][to.GetCol()] / 4;
-      score += (*piece_to_history[4])[piece_type][to.GetRow()][to.GetCol()] / 4;
-
-      stages_[QUIET].emplace_back(i, score);
+    int score = piece_move_order_scores_[piece_type];
+    score += history_heuristic_[piece_type][from.GetRow()][from.GetCol()][to.GetRow()][to.GetCol()] / 2;
+    if (PackedMove(move) == counter_moves_[from.GetRow()*14*14*14 + from.GetCol()*14*14
+        + to.GetRow()*14 + to.GetCol()]) {
+      score += 50;
     }
-  }
+    score += (*piece_to_history_[0])[piece_type][to.GetRow()][to.GetCol()] / 2;
+    score += (*piece_to_history_[1])[piece_type][to.GetRow()][to.GetCol()] / 4;
+    score += (*piece_to_history_[2])[piece_type][to.GetRow()][to.GetCol()] / 4;
+    score += (*piece_to_history_[3])[piece_type][to.GetRow()][to.GetCol()] / 4;
+    score += (*piece_to_history_[4])[piece_type][to.GetRow()][to.GetCol()] / 4;
 
+    stages_[QUIET].emplace_back(i, score);
+  }
 }
 
-Move* MovePicker::GetNextMove() {
-  // Increment stage_ and stage_idx_ until we find the next item
-  while (stage_ < stages_.size() && stage_idx_ >= stages_[stage_].size()) {
-    stage_++;
-    stage_idx_ = 0;
-  }
-  if (stage_ >= stages_.size()) {
-    return nullptr;
+void MovePicker::GenerateStage(uint8_t stage) {
+  switch (stage) {
+  case PV_MOVE:
+    // The PV/TT move may come from another position (hash collision or a
+    // stale PV), so it is played only if it is legal here.
+    if (pvmove_.has_value() && board_->IsLegalMove(*pvmove_)) {
+      const auto piece = board_->GetPiece(pvmove_->From());
+      moves_[num_moves_] = *pvmove_;
+      stages_[PV_MOVE].emplace_back(
+          num_moves_, piece_move_order_scores_[piece.GetPieceType()]);
+      picked_[num_picked_++] = PackedMove(*pvmove_);
+      num_moves_++;
+    }
+    break;
+  case GOOD_CAPTURE:
+    {
+      size_t begin = num_moves_;
+      num_moves_ += board_->GetLegalMoves(
+          moves_ + begin, buffer_size_ - begin, CAPTURES);
+      ScoreCaptures(begin, num_moves_);
+    }
+    break;
+  case KILLER:
+    if (killers_ != nullptr && include_quiets_) {
+      for (int i = 0; i < 2; i++) {
+        std::optional<Move> killer = board_->UnpackMove(killers_[i]);
+        // Captures were returned by the capture stages.
+        if (!killer.has_value() || killer->IsCapture() || IsPicked(*killer)
+            || !board_->IsLegalMove(*killer)) {
+          continue;
+        }
+        const auto piece = board_->GetPiece(killer->From());
+        moves_[num_moves_] = *killer;
+        stages_[KILLER].emplace_back(
+            num_moves_,
+            piece_move_order_scores_[piece.GetPieceType()] + (i == 0 ? 1 : 0));
+        picked_[num_picked_++] = killers_[i];
+        num_moves_++;
+      }
+    }
+    break;
+  case BAD_CAPTURE:
+    // Filled while generating the good captures.
+    break;
+  case QUIET:
+    if (include_quiets_) {
+      size_t begin = num_moves_;
+      num_moves_ += board_->GetLegalMoves(
+          moves_ + begin, buffer_size_ - begin, QUIETS);
+      ScoreQuiets(begin, num_moves_);
+    }
+    break;
+  default:
+    assert(false);
+    break;
   }
+}
 
-  // Init the stage if not already, including scoring and sorting
-  auto& stage_vec = stages_[stage_];
-  if (!init_stages_[stage_]) {
-    if (stage_vec.size() > 1) {
-      if (enable_move_order_checks_) {
-        for (auto& item : stage_vec) {
-          if (moves_[item.index].DeliversCheck(*board_)) {
-            item.score += stage_ == QUIET ? 100'000 : 10'00;
+Move* MovePicker::GetNextMove() {
+  // Increment stage_ and stage_idx_ until we find the next item, generating
+  // each stage when it is reached.
+  while (stage_ < stages_.size()) {
+    auto& stage_vec = stages_[stage_];
+
+    // Init the stage if not already, including scoring and sorting
+    if (!init_stages_[stage_]) {
+      GenerateStage(stage_);
+
+      if (stage_vec.size() > 1) {
+        if (enable_move_order_checks_) {
+          for (auto& item : stage_vec) {
+            if (moves_[item.index].DeliversCheck(*board_, *check_info_)) {
+              item.score += stage_ == QUIET ? 100'000 : 10'00;
+            }
           }
         }
-      }
 
-      struct {
-        bool operator()(const Item& a, const Item& b) {
-          return a.score > b.score;
-        }
-      } customLess;
+        struct {
+          bool operator()(const Item& a, const Item& b) {
+            return a.score > b.score;
+          }
+        } customLess;
 
-      std::sort(stage_vec.begin(), stage_vec.end(), customLess);
+        std::sort(stage_vec.begin(), stage_vec.end(), customLess);
+      }
+
+      init_stages_[stage_] = true;
     }
 
-    init_stages_[stage_] = true;
+    if (stage_idx_ < stage_vec.size()) {
+      break;
+    }
+    stage_++;
+    stage_idx_ = 0;
+  }
+  if (stage_ >= stages_.size()) {
+    return nullptr;
   }
 
-  Move* move = &moves_[stage_vec[stage_idx_].index];
+  Move* move = &moves_[stages_[stage_][stage_idx_].index];
 
   // Increment stage_idx_ for the next call.
   stage_idx_++;
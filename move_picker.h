@@ -89,8 +89,9 @@ class MovePicker {
  public:
   MovePicker(
     Board& board,
+    const CheckInfo& check_info,
     const std::optional<Move>& pvmove,
-    Move* killers,
+    PackedMove* killers,
     const int piece_evaluations[6],
     int history_heuristic[6][14][14][14][14],
     int capture_heuristic[6][4][6][4][14][14],
@@ -98,14 +99,13 @@ class MovePicker {
     bool enable_move_order_checks,
     Move* buffer,
     size_t buffer_size
-    ,Move* counter_moves
+    ,PackedMove* counter_moves
     ,bool include_quiets = true
     ,const PieceToHistory** piece_to_history = nullptr
     );
 
   // If this returns nullptr then there are no more moves
   Move* GetNextMove();
-  int GetNumMoves() const { return num_moves_; };
 
  private:
   struct Item {
@@ -115,14 +115,38 @@ class MovePicker {
     Item(short idx, float sco) : index(idx), score(sco) { }
   };
 
+  // Generates (or collects) the moves of a stage into stages_ and the
+  // buffer. Captures fill both GOOD_CAPTURE and BAD_CAPTURE.
+  void GenerateStage(uint8_t stage);
+  void ScoreCaptures(size_t begin, size_t end);
+  void ScoreQuiets(size_t begin, size_t end);
+  // Whether the move was already returned by an earlier stage.
+  bool IsPicked(const Move& move) const;
+
   Board* board_ = nullptr;
+  const CheckInfo* check_info_ = nullptr;
+  std::optional<Move> pvmove_;
+  PackedMove* killers_ = nullptr;
+  const int* piece_evaluations_ = nullptr;
+  int (*history_heuristic_)[14][14][14][14] = nullptr;
+  int (*capture_heuristic_)[4][6][4][14][14] = nullptr;
+  const int* piece_move_order_scores_ = nullptr;
+  PackedMove* counter_moves_ = nullptr;
+  const PieceToHistory** piece_to_history_ = nullptr;
+  bool include_quiets_ = true;
+
   Move* moves_ = nullptr;
+  size_t buffer_size_ = 0;
   size_t num_moves_ = 0;
   uint8_t stage_ = 0;
   uint8_t stage_idx_ = 0;
   std::vector<std::vector<Item>> stages_;
   bool init_stages_[5] = {false, false, false, false, false};
   bool enable_move_order_checks_;
+  // Moves returned from the PV and killer stages, which the generated
+  // stages skip.
+  PackedMove picked_[3];
+  int num_picked_ = 0;
 };
 
 }  // namespace chess
@@ -0,0 +1,149 @@
+#include "perft.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+
+
+namespace chess {
+
+namespace {
+
+constexpr size_t kMovesPerPly = 300;
+
+// Mixes the depth into the position key so that counts for different
+// depths do not collide.
+uint64_t PerftCheck(int64_t key, int depth) {
+  return static_cast<uint64_t>(key)
+    ^ (static_cast<uint64_t>(depth) * 0x9E3779B97F4A7C15ULL);
+}
+
+bool IsKingCapture(const Move& move) {
+  const auto capture = move.GetStandardCapture();
+  return capture.Present() && capture.GetPieceType() == KING;
+}
+
+uint64_t CountLeaves(Board& board, int depth, Move* buffer,
+                     PerftTable* table) {
+  uint64_t count = 0;
+  if (depth > 1 && table != nullptr
+      && table->Get(board.HashKey(), depth, count)) {
+    return count;
+  }
+
+  size_t num_moves = board.GetLegalMoves(buffer, kMovesPerPly);
+  if (depth == 1) {
+    return num_moves;
+  }
+
+  Move* child_buffer = buffer + kMovesPerPly;
+  for (size_t i = 0; i < num_moves; i++) {
+    const Move& move = buffer[i];
+    if (IsKingCapture(move)) {
+      continue;
+    }
+    board.MakeMove(move);
+    count += CountLeaves(board, depth - 1, child_buffer, table);
+    board.UndoMove();
+  }
+
+  if (table != nullptr) {
+    table->Save(board.HashKey(), depth, count);
+  }
+  return count;
+}
+
+}  // namespace
+
+PerftTable::PerftTable(size_t size)
+  : entries_(std::make_unique<Entry[]>(size)), size_(size) {
+  for (size_t i = 0; i < size_; i++) {
+    entries_[i].check.store(0, std::memory_order_relaxed);
+    entries_[i].count.store(0, std::memory_order_relaxed);
+  }
+}
+
+bool PerftTable::Get(int64_t key, int depth, uint64_t& count) const {
+  uint64_t check = PerftCheck(key, depth);
+  const Entry& entry = entries_[check % size_];
+  uint64_t stored_count = entry.count.load(std::memory_order_relaxed);
+  uint64_t stored_check = entry.check.load(std::memory_order_relaxed);
+  if ((stored_check ^ stored_count) != check) {
+    return false;
+  }
+  count = stored_count;
+  return true;
+}
+
+void PerftTable::Save(int64_t key, int depth, uint64_t count) {
+  uint64_t check = PerftCheck(key, depth);
+  Entry& entry = entries_[check % size_];
+  entry.check.store(check ^ count, std::memory_order_relaxed);
+  entry.count.store(count, std::memory_order_relaxed);
+}
+
+PerftResult Perft(const Board& board, int depth,
+                  const PerftOptions& options) {
+  PerftResult result;
+  if (depth <= 0) {
+    result.nodes = 1;
+    return result;
+  }
+
+  Board root_board = board;
+  std::vector<Move> root_moves(kMovesPerPly);
+  root_moves.resize(root_board.GetLegalMoves(root_moves.data(),
+                                             kMovesPerPly));
+  result.divide.reserve(root_moves.size());
+  for (const auto& move : root_moves) {
+    result.divide.emplace_back(move, depth == 1 ? 1 : 0);
+  }
+  if (depth == 1) {
+    result.nodes = root_moves.size();
+    return result;
+  }
+
+  // Each thread takes the next unclaimed root move until none are left.
+  std::atomic<size_t> next_move = 0;
+  auto run = [&]() {
+    Board thread_board = root_board;
+    std::vector<Move> buffer(kMovesPerPly * depth);
+    while (true) {
+      size_t i = next_move.fetch_add(1);
+      if (i >= root_moves.size()) {
+        break;
+      }
+      const Move& move = root_moves[i];
+      if (IsKingCapture(move)) {
+        continue;
+      }
+      thread_board.MakeMove(move);
+      result.divide[i].second = CountLeaves(
+          thread_board, depth - 1, buffer.data(), options.table);
+      thread_board.UndoMove();
+    }
+  };
+
+  int num_threads = std::max(1, options.num_threads);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (int i = 1; i < num_threads; i++) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (const auto& [move, count] : result.divide) {
+    result.nodes += count;
+  }
+  return result;
+}
+
+}  // namespace chess
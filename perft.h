@@ -0,0 +1,58 @@
+#ifndef _PERFT_H_
+#define _PERFT_H_
+// Perft: counts the leaf nodes of the legal move tree to a fixed depth. Used
+// to check move generation and to benchmark generation and make/unmake.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+
+
+namespace chess {
+
+// Hash table of subtree counts, shared by the perft threads. Each entry
+// stores the count and the count xor'ed with the (key, depth) check, so
+// a torn write from another thread reads back as a miss.
+class PerftTable {
+ public:
+  explicit PerftTable(size_t size);
+
+  bool Get(int64_t key, int depth, uint64_t& count) const;
+  void Save(int64_t key, int depth, uint64_t count);
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> count;
+  };
+
+  std::unique_ptr<Entry[]> entries_;
+  size_t size_ = 0;
+};
+
+struct PerftOptions {
+  // Root moves are split across this many threads.
+  int num_threads = 1;
+  // Optional table of subtree counts. It can be reused across positions.
+  PerftTable* table = nullptr;
+};
+
+struct PerftResult {
+  uint64_t nodes = 0;
+  // Leaf count below each root move, in generation order.
+  std::vector<std::pair<Move, uint64_t>> divide;
+};
+
+// Leaf nodes `depth` plies below the position. Moves that capture a king
+// end the game, so their subtrees are not expanded. The last ply is counted
+// from the legal move list without making the moves (bulk counting).
+PerftResult Perft(const Board& board, int depth,
+                  const PerftOptions& options = PerftOptions());
+
+}  // namespace chess
+
+#endif  // _PERFT_H_
@@ -0,0 +1,98 @@
+// Runs perft over positions from a FEN file and reports node counts and
+// nodes per second. This is the reference benchmark for move generation and
+// make/unmake throughput.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "perft.h"
+#include "utils.h"
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+
+ABSL_FLAG(std::string, fens_filepath, "FENs_4PC_balanced.txt",
+    "FENs filepath, one position per line.");
+ABSL_FLAG(int32_t, num_fens, 20, "Number of FENs to run, from the start of the file");
+ABSL_FLAG(int32_t, depth, 3, "Perft depth");
+ABSL_FLAG(int32_t, num_threads, 1, "Number of threads, splitting root moves");
+ABSL_FLAG(int32_t, hash_size, 0,
+    "Number of perft hash table entries (0 disables the table)");
+ABSL_FLAG(bool, divide, false, "Print the count below each root move");
+
+namespace chess {
+
+namespace {
+
+std::vector<std::string> ParseFENs(const std::string& fens_filepath) {
+  std::ifstream infile(fens_filepath);
+  std::string line;
+  std::vector<std::string> fens;
+  while (std::getline(infile, line)) {
+    if (line.size() < 10) {
+      continue;
+    }
+    fens.push_back(line);
+  }
+  return fens;
+}
+
+}  // namespace
+
+void RunPerft() {
+  std::string fens_filepath = absl::GetFlag(FLAGS_fens_filepath);
+  std::vector<std::string> fens = ParseFENs(fens_filepath);
+  if (fens.empty()) {
+    std::cout << "No FENs found in: " << fens_filepath << std::endl;
+    abort();
+  }
+  int num_fens = std::min<int>(absl::GetFlag(FLAGS_num_fens), fens.size());
+  int depth = absl::GetFlag(FLAGS_depth);
+  bool divide = absl::GetFlag(FLAGS_divide);
+
+  PerftOptions options;
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  std::unique_ptr<PerftTable> table;
+  if (absl::GetFlag(FLAGS_hash_size) > 0) {
+    table = std::make_unique<PerftTable>(absl::GetFlag(FLAGS_hash_size));
+    options.table = table.get();
+  }
+
+  uint64_t total_nodes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_fens; i++) {
+    auto board = ParseBoardFromFEN(fens[i]);
+    if (board == nullptr) {
+      std::cout << "Invalid FEN: " << fens[i] << std::endl;
+      continue;
+    }
+    PerftResult result = Perft(*board, depth, options);
+    if (divide) {
+      for (const auto& [move, count] : result.divide) {
+        std::cout << move.PrettyStr() << ": " << count << std::endl;
+      }
+    }
+    std::cout << "fen " << i << " nodes " << result.nodes << std::endl;
+    total_nodes += result.nodes;
+  }
+  auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "total nodes " << total_nodes
+    << " ms " << duration_ms
+    << " nps " << (duration_ms > 0 ? total_nodes * 1000 / duration_ms : 0)
+    << std::endl;
+}
+
+}  // namespace chess
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  chess::RunPerft();
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+#include "board.h"
+#include "perft.h"
+#include "utils.h"
+
+namespace chess {
+
+namespace {
+
+constexpr char kMiddlegameFEN[] = "R-0,0,0,0-1,1,1,1-1,0,1,1-0,0,0,0-2-x,x,x,yR,yN,1,yK,1,yB,yN,yR,x,x,x/x,x,x,yP,yP,yP,1,yP,yP,yP,yP,x,x,x/x,x,x,3,yP,4,x,x,x/bR,bP,10,gP,gR/bN,bP,10,gP,gN/bB,2,bP,8,gP,1/bQ,bP,9,gP,1,gK/bK,bP,bP,1,yQ,7,gP,1/bB,11,gP,gB/bN,1,bP,6,gB,2,gP,gN/3,bR,1,rP,6,gP,gR/x,x,x,4,rP,3,x,x,x/x,x,x,rP,rP,1,rP,1,rP,rP,rP,x,x,x/x,x,x,rR,1,rB,rQ,rK,1,rN,rR,x,x,x";
+
+// Perft by make/undo filtering of the pseudo-legal moves.
+uint64_t SlowPerft(Board& board, int depth) {
+  Move moves[300];
+  size_t num_moves = board.GetPseudoLegalMoves2(moves, 300);
+  Player player = board.GetTurn();
+  uint64_t count = 0;
+  for (size_t i = 0; i < num_moves; i++) {
+    board.MakeMove(moves[i]);
+    bool king_capture = board.CheckWasLastMoveKingCapture() != IN_PROGRESS;
+    if (king_capture || !board.IsKingInCheck(player)) {
+      if (depth == 1) {
+        count++;
+      } else if (!king_capture) {
+        count += SlowPerft(board, depth - 1);
+      }
+    }
+    board.UndoMove();
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(PerftTest, StandardSetup) {
+  auto board = Board::CreateStandardSetup();
+  Move moves[300];
+  size_t num_moves = board->GetLegalMoves(moves, 300);
+
+  PerftResult result = Perft(*board, 1);
+  EXPECT_EQ(result.nodes, num_moves);
+  ASSERT_EQ(result.divide.size(), num_moves);
+
+  EXPECT_EQ(Perft(*board, 0).nodes, 1);
+  EXPECT_EQ(Perft(*board, 2).nodes, SlowPerft(*board, 2));
+}
+
+TEST(PerftTest, MatchesMakeUndoFiltering) {
+  auto board = ParseBoardFromFEN(kMiddlegameFEN);
+  ASSERT_NE(board, nullptr);
+
+  PerftResult result = Perft(*board, 3);
+  EXPECT_EQ(result.nodes, SlowPerft(*board, 3));
+
+  uint64_t divide_total = 0;
+  for (const auto& [move, count] : result.divide) {
+    divide_total += count;
+  }
+  EXPECT_EQ(divide_total, result.nodes);
+}
+
+TEST(PerftTest, HashAndThreadsDoNotChangeCounts) {
+  auto board = ParseBoardFromFEN(kMiddlegameFEN);
+  ASSERT_NE(board, nullptr);
+  uint64_t expected = Perft(*board, 3).nodes;
+
+  PerftTable table(1 << 16);
+  PerftOptions options;
+  options.table = &table;
+  EXPECT_EQ(Perft(*board, 3, options).nodes, expected);
+  // Counts already in the table.
+  EXPECT_EQ(Perft(*board, 3, options).nodes, expected);
+
+  options.num_threads = 4;
+  PerftResult threaded = Perft(*board, 3, options);
+  EXPECT_EQ(threaded.nodes, expected);
+
+  options.table = nullptr;
+  EXPECT_EQ(Perft(*board, 3, options).nodes, expected);
+}
+
+}  // namespace chess
@@ -19,6 +19,47 @@
 
 namespace chess {
 
+template <PlayerColor kColor>
+void AlphaBetaPlayer::InitializePieceSquareTable() {
+  using Geometry = ColorGeometry<kColor>;
+  for (int pt = 0; pt < 6; pt++) {
+    PieceType piece_type = static_cast<PieceType>(pt);
+    bool is_piece = (piece_type == QUEEN || piece_type == ROOK
+                     || piece_type == BISHOP || piece_type == KNIGHT);
+
+    for (int row = 0; row < 14; row++) {
+      for (int col = 0; col < 14; col++) {
+        int table_value = 0;
+
+        if (options_.enable_piece_square_table && is_piece) {
+          // preference for centrality
+          float center_dist = std::sqrt((row - 6.5) * (row - 6.5)
+                                      + (col - 6.5) * (col - 6.5));
+          table_value -= (int)(10 * center_dist);
+
+          // preference for pieces on opponent team's back-3 rank
+          int side = Geometry::kAdvancesAlongColumn ? col : row;
+          if (side < 3 || side >= 11) {
+            table_value += 10;
+          }
+        }
+
+        if (piece_type == PAWN) {
+          int advancement =
+            Geometry::PawnAdvancement(BoardLocation(row, col));
+          int bonus = 2 * std::pow(advancement, 2);
+          bonus += std::max(150 * (advancement - 5), 0);
+          table_value += bonus;
+        }
+
+        piece_square_table_.values[kColor][piece_type]
+          [SquareIndex(row, col)] =
+          Geometry::kTeam == RED_YELLOW ? table_value : -table_value;
+      }
+    }
+  }
+}
+
 AlphaBetaPlayer::AlphaBetaPlayer(std::optional<PlayerOptions> options) {
   if (options.has_value()) {
     options_ = *options;
@@ -39,8 +80,18 @@ AlphaBetaPlayer::AlphaBetaPlayer(std::optional<PlayerOptions> options) {
   king_attacker_values_[KING] = 0;
 
   if (options_.enable_transposition_table) {
-    transposition_table_ = std::make_unique<TranspositionTable>(
-        options_.transposition_table_size);
+    if (options_.transposition_table_shared_memory.has_value()) {
+      transposition_table_ = std::make_unique<TranspositionTable>(
+          options_.transposition_table_size,
+          *options_.transposition_table_shared_memory, HASH_SHARED_MEMORY);
+    } else if (options_.transposition_table_file.has_value()) {
+      transposition_table_ = std::make_unique<TranspositionTable>(
+          options_.transposition_table_size,
+          *options_.transposition_table_file);
+    } else {
+      transposition_table_ = std::make_unique<TranspositionTable>(
+          options_.transposition_table_size);
+    }
   }
 
   for (int row = 0; row < 14; row++) {
@@ -67,39 +118,27 @@ AlphaBetaPlayer::AlphaBetaPlayer(std::optional<PlayerOptions> options) {
     king_attack_weight_[i] = 400;
   }
 
-  if (options_.enable_piece_square_table) {
-    for (int cl = 0; cl < 4; cl++) {
-      PlayerColor color = static_cast<PlayerColor>(cl);
-      for (int pt = 0; pt < 6; pt++) {
-        PieceType piece_type = static_cast<PieceType>(pt);
-        bool is_piece = (piece_type == QUEEN || piece_type == ROOK
-                         || piece_type == BISHOP || piece_type == KNIGHT);
-
-        for (int row = 0; row < 14; row++) {
-          for (int col = 0; col < 14; col++) {
-            int table_value = 0;
-
-            if (is_piece) {
-              // preference for centrality
-              float center_dist = std::sqrt((row - 6.5) * (row - 6.5)
-                                          + (col - 6.5) * (col - 6.5));
-              table_value -= (int)(10 * center_dist);
-
-              // preference for pieces on opponent team's back-3 rank
-              if (color == RED || color == YELLOW) {
-                if (col < 3 || col >= 11) {
-                  table_value += 10;
-                }
-              } else {
-                if (row < 3 || row >= 11) {
-                  table_value += 10;
-                }
-              }
-            }
+  // Pawn advancement and the piece-square terms, which the search boards
+  // sum incrementally as pieces move.
+  InitializePieceSquareTable<RED>();
+  InitializePieceSquareTable<BLUE>();
+  InitializePieceSquareTable<YELLOW>();
+  InitializePieceSquareTable<GREEN>();
 
-            piece_square_table_[color][piece_type][row][col] = table_value;
-          }
-        }
+  for (int row = 0; row < 14; row++) {
+    for (int col = 0; col < 14; col++) {
+      int square = SquareIndex(row, col);
+      if (row >= 12) {
+        back_ranks_[RED].Set(square);
+      }
+      if (row <= 1) {
+        back_ranks_[YELLOW].Set(square);
+      }
+      if (col <= 1) {
+        back_ranks_[BLUE].Set(square);
+      }
+      if (col >= 12) {
+        back_ranks_[GREEN].Set(square);
       }
     }
   }
@@ -113,56 +152,20 @@ AlphaBetaPlayer::AlphaBetaPlayer(std::optional<PlayerOptions> options) {
     piece_activation_threshold_[KNIGHT] = 3;
     piece_activation_threshold_[ROOK] = 5;
   }
-
-  if (options_.enable_knight_bonus) {
-    std::memset(knight_to_king_, 0, 14*14*14*14 * sizeof(bool) / sizeof(char));
-    for (int row = 0; row < 14; ++row) {
-      for (int col = 0; col < 14; ++col) {
-        // first move
-        for (int dr : {-2, -1, 1, 2}) {
-          int r1 = row + dr;
-          if (r1 < 0 || r1 > 13) {
-            continue;
-          }
-          int abs_dc = std::abs(dr) == 1 ? 2 : 1;
-          for (int dc : {-abs_dc, abs_dc}) {
-            int c1 = col + dc;
-            if (c1 < 0 || c1 > 13) {
-              continue;
-            }
-
-            // second move
-            for (int dr2 : {-2, -1, 1, 2}) {
-              int r2 = r1 + dr2;
-              if (r2 < 0 || r2 > 13) {
-                continue;
-              }
-              int abs_dc2 = std::abs(dr2) == 1 ? 2 : 1;
-              for (int dc2 : {-abs_dc2, abs_dc2}) {
-                int c2 = c1 + dc2;
-                if (c2 < 0 || c2 > 13) {
-                  continue;
-                }
-                knight_to_king_[row][col][r2][c2] = true;
-              }
-            }
-          }
-        }
-      }
-    }
-  }
 }
 
 
 ThreadState::ThreadState(
     PlayerOptions options, const Board& board, const PVInfo& pv_info)
   : options_(options), board_(board), pv_info_(pv_info) {
+  board_.ReserveMoves();
   move_buffer_ = new Move[kBufferPartitionSize * kBufferNumPartitions];
-  counter_moves = new Move[14*14*14*14];
+  counter_moves = new PackedMove[14*14*14*14];
   continuation_history = new ContinuationHistory*[2];
   for (int i = 0; i < 2; i++) {
     continuation_history[i] = new ContinuationHistory[2];
   }
+  pawn_hash_table = new PawnHashEntry[kPawnHashTableSize];
 }
 
 ThreadState::~ThreadState() {
@@ -172,6 +175,7 @@ ThreadState::~ThreadState() {
     delete[] continuation_history[i];
   }
   delete[] continuation_history;
+  delete[] pawn_hash_table;
 }
 
 Move* ThreadState::GetNextMoveBufferPartition() {
@@ -190,19 +194,7 @@ void ThreadState::ReleaseMoveBufferPartition() {
 int AlphaBetaPlayer::GetNumLegalMoves(Board& board) {
   constexpr int kLimit = 300;
   Move moves[kLimit];
-  Player player = board.GetTurn();
-  size_t num_moves = board.GetPseudoLegalMoves2(moves, kLimit);
-  int n_legal = 0;
-  for (size_t i = 0; i < num_moves; i++) {
-    const auto& move = moves[i];
-    board.MakeMove(move);
-    if (!board.IsKingInCheck(player)) { // invalid move
-      n_legal++;
-    }
-    board.UndoMove();
-  }
-
-  return n_legal;
+  return board.GetLegalMoves(moves, kLimit);
 }
 
 // Alpha-beta search with nega-max framework.
@@ -272,36 +264,34 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
   bool is_tt_pv = false, tt_hit = false;
 
   std::optional<Move> tt_move;
-  const HashTableEntry* tte = nullptr;
+  std::optional<HashTableEntry> tte;
 
   if (options_.enable_transposition_table)
   {
     int64_t key = board.HashKey();
 
     tte = transposition_table_->Get(key);
-    if (tte != nullptr)
+    if (tte.has_value())
     {
-      if (tte->key == key)
+      // valid entry
+      if (tte->depth >= depth)
       {
-        // valid entry
-        if (tte->depth >= depth)
-        {
-          num_cache_hits_++;
-
-          // at non pv nodes check for an early TT cutoff
-          if (!is_root_node && !is_pv_node && (tte->bound == EXACT
-             || (tte->bound == LOWER_BOUND && tte->score >= beta)
-             || (tte->bound == UPPER_BOUND && tte->score <= alpha))
-          ) {
-            return std::make_tuple(std::min(beta, std::max(alpha, tte->score)), tte->move);
-          }
+        num_cache_hits_++;
+
+        // at non pv nodes check for an early TT cutoff
+        if (!is_root_node && !is_pv_node && (tte->bound == EXACT
+           || (tte->bound == LOWER_BOUND && tte->score >= beta)
+           || (tte->bound == UPPER_BOUND && tte->score <= alpha))
+        ) {
+          return std::make_tuple(std::min(beta, std::max(alpha, tte->score)),
+                                 board.UnpackMove(tte->move));
         }
-       
-        // update tt vars
-        tt_hit   = true;
-        tt_move  = tte->move;
-        is_tt_pv = tte->is_pv;
       }
+
+      // update tt vars
+      tt_hit   = true;
+      tt_move  = board.UnpackMove(tte->move);
+      is_tt_pv = tte->is_pv;
     }
   }
   
@@ -353,7 +343,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
   }
   
   // reset killers
-  (ss + 2)->killers[0] = (ss + 2)->killers[1] = Move();
+  (ss + 2)->killers[0] = (ss + 2)->killers[1] = PackedMove();
   
   // reset move count
   ss->move_count = 0;
@@ -469,8 +459,11 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
 
   std::optional<Move> pv_move = pvinfo.GetBestMove();
   Move* moves = thread_state.GetNextMoveBufferPartition();
+  const CheckInfo check_info =
+    board.GetCheckInfo(options_.enable_discovered_checks);
   MovePicker move_picker(
     board,
+    check_info,
     pv_move.has_value() ? pv_move : tt_move,
     ss->killers,
     kPieceEvaluations,
@@ -507,7 +500,7 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     std::optional<std::tuple<int, std::optional<Move>>> value_and_move_or;
 
     // this has to be called before the move is made
-    bool delivers_check = move.DeliversCheck(board);
+    bool delivers_check = move.DeliversCheck(board, check_info);
 
     bool lmr =
       options_.enable_late_move_reduction
@@ -540,7 +533,9 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
     }
 
     // is this a killer move
-    const int is_killer = ss->killers[0] == move || ss->killers[1] == move;
+    const PackedMove packed_move(move);
+    const int is_killer = ss->killers[0] == packed_move
+      || ss->killers[1] == packed_move;
 
     int r = 1 + std::max(0,(depth-5)/3) + move_count/30;
 
@@ -619,6 +614,10 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
       }
     }
 
+    if (options_.enable_transposition_table) {
+      transposition_table_->Prefetch(board.HashKeyAfter(move));
+    }
+
     ss->current_move = move;
     ss->continuation_history = &thread_state.continuation_history[ss->in_check][move.IsCapture()][piece_type][move.To().GetRow()][move.To().GetCol()];
 
@@ -634,12 +633,6 @@ std::optional<std::tuple<int, std::optional<Move>>> AlphaBetaPlayer::Search(
       break;
     }
 
-    if (board.IsKingInCheck(player)) { // invalid move
-      board.UndoMove();
-
-      continue;
-    }
-
     has_legal_moves = true;
 
     ss->move_count = move_count++;
@@ -834,28 +827,26 @@ AlphaBetaPlayer::QSearch(
 
   std::optional<Move> tt_move;
 
-  const HashTableEntry* tte = nullptr;
+  std::optional<HashTableEntry> tte;
   if (options_.enable_transposition_table) {
     int64_t key = board.HashKey();
 
     tte = transposition_table_->Get(key);
-    if (tte != nullptr) {
-      if (tte->key == key) { // valid entry
-        if (tte->depth >= tt_depth) {
-          num_cache_hits_++;
-          // at non-PV nodes check for an early TT cutoff
-          if (!is_pv_node
-              && (tte->bound == EXACT
-                || (tte->bound == LOWER_BOUND && tte->score >= beta)
-                || (tte->bound == UPPER_BOUND && tte->score <= alpha))
-             ) {
-
-            return std::make_tuple(
-                std::min(beta, std::max(alpha, tte->score)), std::nullopt);
-          }
+    if (tte.has_value()) { // valid entry
+      if (tte->depth >= tt_depth) {
+        num_cache_hits_++;
+        // at non-PV nodes check for an early TT cutoff
+        if (!is_pv_node
+            && (tte->bound == EXACT
+              || (tte->bound == LOWER_BOUND && tte->score >= beta)
+              || (tte->bound == UPPER_BOUND && tte->score <= alpha))
+           ) {
+
+          return std::make_tuple(
+              std::min(beta, std::max(alpha, tte->score)), std::nullopt);
         }
-        tt_move = tte->move;
       }
+      tt_move = board.UnpackMove(tte->move);
     }
 
   }
@@ -928,8 +919,11 @@ AlphaBetaPlayer::QSearch(
 
   std::optional<Move> pv_move = pv_info.GetBestMove();
   Move* moves = thread_state.GetNextMoveBufferPartition();
+  const CheckInfo check_info =
+    board.GetCheckInfo(options_.enable_discovered_checks);
   MovePicker move_picker(
     board,
+    check_info,
     pv_move,
     ss->killers,
     kPieceEvaluations,
@@ -963,8 +957,8 @@ AlphaBetaPlayer::QSearch(
           // small optimization on SEE calculation
           if (move.GetCapturePiece().GetPieceType() != QUEEN
               && board.GetPiece(move.From()).GetPieceType() != PAWN) {
-            int see = StaticExchangeEvaluationCapture(kPieceEvaluations, board, move);
-            if (see < 0) {
+            if (!board.StaticExchangeEvaluationGe(
+                    move, 0, kPieceEvaluations)) {
               continue;
             }
           }
@@ -976,11 +970,15 @@ AlphaBetaPlayer::QSearch(
 
     std::optional<std::tuple<int, std::optional<Move>>> value_and_move_or;
 
+    if (options_.enable_transposition_table) {
+      transposition_table_->Prefetch(board.HashKeyAfter(move));
+    }
+
     PieceType piece_type = board.GetPiece(move.From()).GetPieceType();
     ss->current_move = move;
     ss->continuation_history = &thread_state.continuation_history[ss->in_check][move.IsCapture()][piece_type][move.To().GetRow()][move.To().GetCol()];
 
-    bool delivers_check = move.DeliversCheck(board);
+    bool delivers_check = move.DeliversCheck(board, check_info);
     board.MakeMove(move);
     if (board.CheckWasLastMoveKingCapture() != IN_PROGRESS) {
       board.UndoMove();
@@ -991,11 +989,6 @@ AlphaBetaPlayer::QSearch(
       break;
     }
 
-    if (board.IsKingInCheck(player)) { // invalid move
-      board.UndoMove();
-      continue;
-    }
-
     move_count++;
 
     bool is_pv_move = pv_move.has_value() && *pv_move == move;
@@ -1125,7 +1118,7 @@ void AlphaBetaPlayer::UpdateStats(
     }
     if (options_.enable_counter_move_heuristic) {
       thread_state.counter_moves[from.GetRow()*14*14*14 + from.GetCol()*14*14
-        + to.GetRow()*14 + to.GetCol()] = move;
+        + to.GetRow()*14 + to.GetCol()] = PackedMove(move);
     }
     UpdateQuietStats(ss, move);
     UpdateContinuationHistories(ss, move, piece.GetPieceType(), bonus);
@@ -1150,9 +1143,10 @@ void AlphaBetaPlayer::UpdateStats(
 
 void AlphaBetaPlayer::UpdateQuietStats(Stack* ss, const Move& move) {
   if (options_.enable_killers) {
-    if (ss->killers[0] != move) {
+    PackedMove packed_move(move);
+    if (ss->killers[0] != packed_move) {
       ss->killers[1] = ss->killers[0];
-      ss->killers[0] = move;
+      ss->killers[0] = packed_move;
     }
   }
 }
@@ -1177,7 +1171,7 @@ constexpr int kPieceImbalanceTable[16] = {
   -400, -400, -400, -400, -400, -400, -400, -400,
 };
 
-int GetNumMajorPieces(const std::vector<PlacedPiece>& pieces) {
+int GetNumMajorPieces(const PieceList& pieces) {
   int num_major = 0;
   for (const auto& placed_piece : pieces) {
     PieceType pt = placed_piece.GetPiece().GetPieceType();
@@ -1188,8 +1182,99 @@ int GetNumMajorPieces(const std::vector<PlacedPiece>& pieces) {
   return num_major;
 }
 
+// Squares from which a rook of the color has one of the pawns up to 6
+// squares ahead.
+template <PlayerColor kColor>
+Bitboard SquaresBehindPawns(const Bitboard& pawns) {
+  using Geometry = ColorGeometry<kColor>;
+  Bitboard squares;
+  Bitboard remaining = pawns;
+  while (remaining.Any()) {
+    BoardLocation loc = BoardLocation::FromSquare(remaining.PopLsb());
+    for (int i = 1; i < 7; i++) {
+      int row = loc.GetRow() - i * Geometry::kForwardRow;
+      int col = loc.GetCol() - i * Geometry::kForwardCol;
+      if (row < 0 || row > 13 || col < 0 || col > 13) {
+        break;
+      }
+      squares.Set(SquareIndex(row, col));
+    }
+  }
+  return squares;
+}
+
 }  // namespace
 
+const PawnHashEntry& AlphaBetaPlayer::ProbePawnHash(
+    ThreadState& thread_state, Board& board) {
+  int64_t key = board.PawnKey();
+  PawnHashEntry& entry =
+    thread_state.pawn_hash_table[(uint64_t)key % kPawnHashTableSize];
+  if (entry.key == key) {
+    return entry;
+  }
+
+  entry.key = key;
+  const Bitboard& pawns = board.GetPieceTypeBitboard(PAWN);
+  entry.rook_blocked[RED] = SquaresBehindPawns<RED>(pawns);
+  entry.rook_blocked[BLUE] = SquaresBehindPawns<BLUE>(pawns);
+  entry.rook_blocked[YELLOW] = SquaresBehindPawns<YELLOW>(pawns);
+  entry.rook_blocked[GREEN] = SquaresBehindPawns<GREEN>(pawns);
+  for (int color = 0; color < 4; color++) {
+    PlayerColor pl_cl = static_cast<PlayerColor>(color);
+    const auto king_location = board.GetKingLocation(pl_cl);
+    entry.pawn_shield[color] = king_location.Present()
+      && HasShield(board, pl_cl, king_location, /*pawns_only=*/true);
+  }
+  return entry;
+}
+
+template <PlayerColor kColor>
+int AlphaBetaPlayer::EvaluatePieces(
+    const Board& board, const PawnHashEntry& pawn_entry, int& n_queens) {
+  using Geometry = ColorGeometry<kColor>;
+  const Bitboard& pieces = board.GetColorBitboard(kColor);
+  int eval = 0;
+
+  n_queens += (board.GetPieceTypeBitboard(QUEEN) & pieces).PopCount();
+
+  Bitboard rooks = board.GetPieceTypeBitboard(ROOK) & pieces;
+  while (rooks.Any()) {
+    BoardLocation loc = BoardLocation::FromSquare(rooks.PopLsb());
+    int row = loc.GetRow();
+    int col = loc.GetCol();
+    int rook_bonus = 0;
+    constexpr int kRookBonus1 = 50;
+    constexpr int kRookBonus2 = 25;
+    if (col >= 4 && col <= 10 && row >= 4 && row <= 10) {
+      rook_bonus = kRookBonus1;
+    } else if (!pawn_entry.rook_blocked[kColor].Test(loc.Square())) {
+      // Open file (or rank) ahead of the rook
+      rook_bonus = kRookBonus2;
+    }
+    eval += rook_bonus;
+  }
+
+  // bonus for knights 2 moves away from enemy king
+  if (options_.enable_knight_bonus) {
+    Bitboard knights = board.GetPieceTypeBitboard(KNIGHT) & pieces;
+    while (knights.Any()) {
+      int square = knights.PopLsb();
+      for (int i = 0; i < 2; i++) {
+        PlayerColor other_color = static_cast<PlayerColor>(
+            (kColor + 2 * i + 1) % 4);
+        auto king_loc = board.GetKingLocation(other_color);
+        if (king_loc.Present()
+            && KnightTwoMovesMask(square).Test(king_loc.Square())) {
+          eval += 100;
+        }
+      }
+    }
+  }
+
+  return Geometry::kTeam == RED_YELLOW ? eval : -eval;
+}
+
 int AlphaBetaPlayer::Evaluate(
     ThreadState& thread_state, bool maximizing_player, int alpha, int beta) {
   int eval; // w.r.t. RY team
@@ -1204,6 +1289,16 @@ int AlphaBetaPlayer::Evaluate(
       eval = 0; // stalemate
     }
   } else {
+    // Probed on first use, so that an evaluation without the rook and pawn
+    // shield terms (or cut short by lazy eval) does not touch the table.
+    const PawnHashEntry* pawn_entry = nullptr;
+    auto get_pawn_entry = [&]() -> const PawnHashEntry& {
+      if (pawn_entry == nullptr) {
+        pawn_entry = &ProbePawnHash(thread_state, board);
+      }
+      return *pawn_entry;
+    };
+
     // Piece evaluation
     eval = board.PieceEvaluation();
 
@@ -1218,113 +1313,18 @@ int AlphaBetaPlayer::Evaluate(
     eval -= threat_value(thread_state.n_threats[BLUE],
                          thread_state.n_threats[GREEN]);
 
-    int n_queen_ry = 0;
-    int n_queen_bg = 0;
+    int n_queens[4] = {0, 0, 0, 0};
     if (options_.enable_piece_square_table
         || options_.enable_knight_bonus) {
-      const auto& piece_list = board.GetPieceList();
-      for (int color = 0; color < 4; color++) {
-        for (const auto& placed_piece : piece_list[color]) {
-          PieceType piece_type = placed_piece.GetPiece().GetPieceType();
-          const auto& loc = placed_piece.GetLocation();
-          int row = loc.GetRow();
-          int col = loc.GetCol();
-
-          if (piece_type == QUEEN) {
-            if (color == RED || color == YELLOW) {
-              n_queen_ry++;
-            } else {
-              n_queen_bg++;
-            }
-          } else if (piece_type == PAWN) {
-            int advancement = 0;
-            switch (color) {
-            case RED:
-              advancement = 12 - row;
-              break;
-            case YELLOW:
-              advancement = row - 1;
-              break;
-            case BLUE:
-              advancement = col - 1;
-              break;
-            case GREEN:
-              advancement = 12 - col;
-              break;
-            default:
-              break;
-            }
-            int bonus = 2 * std::pow(advancement, 2);
-            bonus += std::max(150 * (advancement - 5), 0);
-            if (color == RED || color == YELLOW) {
-              eval += bonus;
-            } else {
-              eval -= bonus;
-            }
-          } else if (piece_type == ROOK) {
-            int rook_bonus = 0;
-            constexpr int kRookBonus1 = 50;
-            constexpr int kRookBonus2 = 25;
-            if (col >= 4 && col <= 10 && row >= 4 && row <= 10) {
-              rook_bonus = kRookBonus1;
-            } else {
-              int delta_row = color == RED ? -1 : color == YELLOW ? 1 : 0;
-              int delta_col = color == BLUE ? 1 : color == GREEN ? -1: 0;
-              int blocked_by_pawn = false;
-              for (int i = 1; i < 7; i++) {
-                int r = row + i * delta_row;
-                int c = col + i * delta_col;
-                if (board.IsLegalLocation(r, c)) {
-                  const auto& other_piece = board.GetPiece(r, c);
-                  if (other_piece.GetPieceType() == PAWN) {
-                    blocked_by_pawn = true;
-                    break;
-                  }
-                }
-              }
-              if (!blocked_by_pawn) {
-                rook_bonus = kRookBonus2;
-              }
-            }
-
-            if (color == RED || color == YELLOW) {
-              eval += rook_bonus;
-            } else {
-              eval -= rook_bonus;
-            }
-          }
-
-          if (options_.enable_piece_square_table) {
-            if (color == RED || color == YELLOW) {
-              eval += piece_square_table_[color][piece_type][row][col];
-            } else {
-              eval -= piece_square_table_[color][piece_type][row][col];
-            }
-          }
-
-          // bonus for knights 2 moves away from enemy king
-          if (options_.enable_knight_bonus
-              && piece_type == KNIGHT) {
-            int knight_bonus = 0;
-            for (int i = 0; i < 2; i++) {
-              PlayerColor other_color = static_cast<PlayerColor>(
-                  (color + 2 * i + 1) % 4);
-              auto king_loc = board.GetKingLocation(other_color);
-              int king_row = king_loc.GetRow();
-              int king_col = king_loc.GetCol();
-              if (knight_to_king_[row][col][king_row][king_col]) {
-                knight_bonus += 100;
-              }
-            }
-            if (color == RED || color == YELLOW) {
-              eval += knight_bonus;
-            } else {
-              eval -= knight_bonus;
-            }
-          }
-        }
-      }
+      eval += board.PositionalEvaluation();
+      const PawnHashEntry& entry = get_pawn_entry();
+      eval += EvaluatePieces<RED>(board, entry, n_queens[RED]);
+      eval += EvaluatePieces<BLUE>(board, entry, n_queens[BLUE]);
+      eval += EvaluatePieces<YELLOW>(board, entry, n_queens[YELLOW]);
+      eval += EvaluatePieces<GREEN>(board, entry, n_queens[GREEN]);
     }
+    int n_queen_ry = n_queens[RED] + n_queens[YELLOW];
+    int n_queen_bg = n_queens[BLUE] + n_queens[GREEN];
 
     int activation_ry = 0;
     int activation_bg = 0;
@@ -1451,7 +1451,8 @@ int AlphaBetaPlayer::Evaluate(
 
           if (options_.enable_pawn_shield
               && opponent_has_queen) {
-            bool shield = HasShield(board, pl_cl, king_location);
+            bool shield = get_pawn_entry().pawn_shield[color]
+              || HasShield(board, pl_cl, king_location);
             bool on_back_rank = OnBackRank(king_location);
             if (!shield) {
               safety -= 75;
@@ -1476,6 +1477,10 @@ int AlphaBetaPlayer::Evaluate(
                 if (!board.IsLegalLocation(loc) || OnBackRank(loc)) {
                   continue;
                 }
+                // Without enemy attackers the square adds no penalty.
+                if (board.GetAttackCount(OtherTeam(team), loc) == 0) {
+                  continue;
+                }
                 BoardLocation piece_location(row, col);
 
                 PlacedPiece attackers[15];
@@ -1576,10 +1581,34 @@ void AlphaBetaPlayer::ResetMobilityScores(ThreadState& thread_state) {
 int AlphaBetaPlayer::StaticEvaluation(Board& board) {
   auto pv_copy = pv_info_.Copy();
   ThreadState thread_state(options_, board, *pv_copy);
+  thread_state.GetBoard().SetPieceSquareTable(&piece_square_table_);
   ResetMobilityScores(thread_state);
   return Evaluate(thread_state, true, -kMateValue, kMateValue);
 }
 
+void AlphaBetaPlayer::ClearTranspositionTable() {
+  if (transposition_table_ != nullptr) {
+    // Other processes may be searching on a mapped table: only age its
+    // entries.
+    if (transposition_table_->IsMapped()) {
+      transposition_table_->NewSearch();
+    } else {
+      transposition_table_->Clear();
+    }
+  }
+  last_board_key_ = 0;
+}
+
+bool AlphaBetaPlayer::SaveTranspositionTable(const std::string& path) const {
+  return transposition_table_ != nullptr
+    && transposition_table_->SaveToFile(path);
+}
+
+bool AlphaBetaPlayer::LoadTranspositionTable(const std::string& path) {
+  return transposition_table_ != nullptr
+    && transposition_table_->LoadFromFile(path);
+}
+
 std::optional<std::tuple<int, std::optional<Move>, int>>
 AlphaBetaPlayer::MakeMove(
     Board& board,
@@ -1592,6 +1621,10 @@ AlphaBetaPlayer::MakeMove(
     asp_nobs_ = 0;
     asp_sum_ = 0;
     asp_sum_sq_ = 0;
+    // Entries from the searches of earlier moves give way to this one.
+    if (transposition_table_ != nullptr) {
+      transposition_table_->NewSearch();
+    }
   }
   last_board_key_ = hash_key;
 
@@ -1618,6 +1651,7 @@ AlphaBetaPlayer::MakeMove(
     auto pv_copy = pv_info_.Copy();
     thread_states.emplace_back(options_, board, *pv_copy);
     auto& thread_state = thread_states.back();
+    thread_state.GetBoard().SetPieceSquareTable(&piece_square_table_);
     ResetMobilityScores(thread_state);
     thread_state.ResetHistoryHeuristic();
   }
@@ -1783,102 +1817,102 @@ int PVInfo::GetDepth() const {
 void AlphaBetaPlayer::UpdateMobilityEvaluation(
     ThreadState& thread_state, Player player) {
   Board& board = thread_state.GetBoard();
-
-  Move* moves = thread_state.GetNextMoveBufferPartition();
-  Player curr_player = board.GetTurn();
-  board.SetPlayer(player);
-  size_t num_moves = board.GetPseudoLegalMoves2(
-      moves, kBufferPartitionSize);
-  int color = player.GetColor();
-  thread_state.TotalMoves()[color] = num_moves;
-
-  if (options_.enable_piece_activation) {
-    auto piece_activated = [this](
-        int color, PieceType piece_type,
-        const BoardLocation& location, int n_moves) {
-      if (piece_type == KNIGHT) {
-        // activated so long as it's not on the back rank
-        int row = location.GetRow();
-        int col = location.GetCol();
-        bool back_rank = (color == RED && row == 13)
-                      || (color == YELLOW && row == 0)
-                      || (color == BLUE && col == 0)
-                      || (color == GREEN && col == 13);
-        return !back_rank;
+  PlayerColor color = player.GetColor();
+
+  // Counts the pseudo-legal moves of the color (see GetPseudoLegalMoves2).
+  // Knight and slider moves are counted from their attack sets, so only
+  // pawn and king moves are generated.
+  int num_moves = 0;
+  int n_pieces_activated = 0;
+  int n_threats = 0;
+  if (board.GetKingLocation(color).Present()) {
+    Move* moves = thread_state.GetNextMoveBufferPartition();
+    MoveBuffer move_buffer;
+    move_buffer.buffer = moves;
+    move_buffer.limit = kBufferPartitionSize;
+
+    const Bitboard& occupied = board.GetOccupiedBitboard();
+    Bitboard own = board.GetTeamBitboard(player.GetTeam());
+    Bitboard enemy = board.GetTeamBitboard(OtherTeam(player.GetTeam()));
+    // Enemy pieces whose capture by the piece type has ApproxSEE >= 100
+    Bitboard threatened[6];
+    for (int pt = KNIGHT; pt <= QUEEN; pt++) {
+      for (int captured = 0; captured < 6; captured++) {
+        if (kPieceEvaluations[captured] - kPieceEvaluations[pt] >= 100) {
+          threatened[pt] |= board.GetPieceTypeBitboard(
+              static_cast<PieceType>(captured)) & enemy;
+        }
       }
-      return n_moves >= piece_activation_threshold_[piece_type];
-    };
+    }
 
-    // note: this computation is dependent on the implementation of
-    // Board::GetPseudoLegalMoves2, which adds all moves for a given
-    // piece/location at a time.
-    BoardLocation last_loc = BoardLocation::kNoLocation;
-    PieceType last_piece_type = NO_PIECE;
-    int n_pieces_activated = 0;
-    int n_moves = 0;
-    int n_threats = 0;
-    for (size_t move_id = 0; move_id < num_moves; move_id++) {
-      auto& move = moves[move_id];
-      const auto& from = move.From();
-      const auto& to = move.To();
-      const auto& piece = board.GetPiece(from);
+    for (const auto& placed_piece : board.GetPieceList()[color]) {
+      const auto& location = placed_piece.GetLocation();
+      const auto& piece = placed_piece.GetPiece();
       PieceType piece_type = piece.GetPieceType();
+      int square = location.Square();
 
-      if (move.IsCapture()) {
-        int see = move.ApproxSEE(board, kPieceEvaluations);
-        if (see >= 100) {
-          n_threats++;
-        }
-      }
-
-      // don't count back rank squares in mobility / activation
-      switch (piece.GetColor()) {
-      case RED:
-        if (to.GetRow() >= 12) {
-          continue;
-        }
+      Bitboard targets;
+      switch (piece_type) {
+      case KNIGHT:
+        targets = KnightMask(square);
         break;
-      case YELLOW:
-        if (to.GetRow() <= 1) {
-          continue;
-        }
+      case BISHOP:
+        targets = BishopAttackMask(square, occupied);
         break;
-      case BLUE:
-        if (to.GetCol() <= 1) {
-          continue;
-        }
+      case ROOK:
+        targets = RookAttackMask(square, occupied);
         break;
-      case GREEN:
-        if (to.GetCol() >= 12) {
-          continue;
-        }
+      case QUEEN:
+        targets = QueenAttackMask(square, occupied);
         break;
       default:
-        break;
-      }
-
-      if (piece_type == QUEEN || piece_type == ROOK || piece_type == BISHOP
-          || piece_type == KNIGHT) {
-        if (from != last_loc) {
-          if (piece_activated(color, last_piece_type, last_loc, n_moves)) {
-            n_pieces_activated++;
+        // Pawn and king moves depend on en-passant and castling state
+        move_buffer.pos = 0;
+        board.GetPieceMoves2(move_buffer, location, piece);
+        num_moves += move_buffer.pos;
+        for (size_t move_id = 0; move_id < move_buffer.pos; move_id++) {
+          auto& move = moves[move_id];
+          if (move.IsCapture()
+              && move.ApproxSEE(board, kPieceEvaluations) >= 100) {
+            n_threats++;
           }
-          last_loc = from;
-          last_piece_type = piece_type;
-          n_moves = 0;
         }
-        n_moves++;
+        continue;
+      }
+      targets = targets.AndNot(own);
+      num_moves += targets.PopCount();
+      n_threats += (targets & threatened[piece_type]).PopCount();
+
+      if (options_.enable_piece_activation) {
+        // don't count back rank squares in mobility / activation
+        int n_moves = targets.AndNot(back_ranks_[color]).PopCount();
+        if (n_moves == 0) {
+          continue;
+        }
+        if (piece_type == KNIGHT) {
+          // activated so long as it's not on the back rank
+          int row = location.GetRow();
+          int col = location.GetCol();
+          bool back_rank = (color == RED && row == 13)
+                        || (color == YELLOW && row == 0)
+                        || (color == BLUE && col == 0)
+                        || (color == GREEN && col == 13);
+          n_pieces_activated += !back_rank;
+        } else {
+          n_pieces_activated +=
+            n_moves >= piece_activation_threshold_[piece_type];
+        }
       }
     }
-    if (piece_activated(color, last_piece_type, last_loc, n_moves)) {
-      n_pieces_activated++;
-    }
+
+    thread_state.ReleaseMoveBufferPartition();
+  }
+
+  thread_state.TotalMoves()[color] = num_moves;
+  if (options_.enable_piece_activation) {
     thread_state.NActivated()[color] = n_pieces_activated;
     thread_state.n_threats[color] = n_threats;
   }
-
-  board.SetPlayer(curr_player);
-  thread_state.ReleaseMoveBufferPartition();
 }
 
 bool AlphaBetaPlayer::OnBackRank(
@@ -1888,7 +1922,8 @@ bool AlphaBetaPlayer::OnBackRank(
 }
 
 bool AlphaBetaPlayer::HasShield(
-    Board& board, PlayerColor color, const BoardLocation& king_loc) {
+    Board& board, PlayerColor color, const BoardLocation& king_loc,
+    bool pawns_only) {
   int row = king_loc.GetRow();
   int col = king_loc.GetCol();
 
@@ -1900,7 +1935,8 @@ bool AlphaBetaPlayer::HasShield(
       }
       const auto piece = board.GetPiece(loc);
       if (piece.Present()
-          && piece.GetColor() == color) {
+          && piece.GetColor() == color
+          && (!pawns_only || piece.GetPieceType() == PAWN)) {
         return true;
       }
     }
@@ -5,6 +5,7 @@
 #include <chrono>
 #include <memory>
 #include <optional>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -44,6 +45,10 @@ struct PlayerOptions {
   bool pvs = true;
   bool enable_transposition_table = true;
   bool enable_check_extensions = true;
+  // Count discovered checks (and exact checks after castling, en passant
+  // and promotion) as checks for the extensions, pruning and ordering.
+  // Off by default: only direct checks by the moved piece count.
+  bool enable_discovered_checks = false;
   bool enable_qsearch = true;
   bool enable_aspiration_window = true;
   bool enable_probcut = true;
@@ -79,11 +84,16 @@ struct PlayerOptions {
 
   // transposition table
   size_t transposition_table_size = kTranspositionTableSize;
+  // If set, the table is mapped from this file and kept across runs.
+  std::optional<std::string> transposition_table_file;
+  // If set, the table is mapped from the POSIX shared memory segment of
+  // this name, shared with other processes. Takes precedence over the file.
+  std::optional<std::string> transposition_table_shared_memory;
   std::optional<int> max_search_depth;
 };
 
 struct Stack {
-  Move killers[2];
+  PackedMove killers[2];
   bool tt_pv = false;
   int move_count = 0;
   // indexed by (piece_type, row, col)
@@ -101,6 +111,20 @@ enum NodeType {
   Root,
 };
 
+constexpr size_t kPawnHashTableSize = 1 << 14;  // entries per thread
+
+// Pawn structure and king shelter terms of a position, keyed by
+// Board::PawnKey().
+struct PawnHashEntry {
+  int64_t key = 0;
+  // Indexed by PlayerColor: squares from which a rook of the color has a
+  // pawn (of any color) up to 6 squares ahead.
+  Bitboard rook_blocked[4];
+  // Indexed by PlayerColor: whether the color's own pawns alone shield its
+  // king.
+  bool pawn_shield[4] = {false, false, false, false};
+};
+
 constexpr size_t kBufferPartitionSize = 300; // number of elements per buffer partition
 constexpr size_t kBufferNumPartitions = 200; // number of recursive calls
 
@@ -125,9 +149,11 @@ class ThreadState {
   int capture_heuristic[6][4][6][4][14][14];
   // https://www.chessprogramming.org/Countermove_Heuristic
   // (from_row, from_col, to_row, to_col)
-  Move* counter_moves = nullptr;
+  PackedMove* counter_moves = nullptr;
   // indexed by (in_check, is_capture)
   ContinuationHistory** continuation_history = nullptr;
+  // kPawnHashTableSize entries, indexed by the low bits of the pawn key.
+  PawnHashEntry* pawn_hash_table = nullptr;
 
   int n_threats[4] = {0, 0, 0, 0};
 
@@ -157,6 +183,12 @@ class AlphaBetaPlayer {
       std::optional<std::chrono::milliseconds> time_limit = std::nullopt,
       int max_depth = 20);
   int StaticEvaluation(Board& board);
+  // Forgets the results of earlier searches, e.g. for a new game. A table
+  // mapped from a file or shared memory is kept, with its entries aged.
+  void ClearTranspositionTable();
+  // Snapshot of the transposition table, see TranspositionTable::SaveToFile.
+  bool SaveTranspositionTable(const std::string& path) const;
+  bool LoadTranspositionTable(const std::string& path);
   // Eval with respect to the maximizing player
   int Evaluate(ThreadState& thread_state, bool maximizing_player,
       int alpha = -kMateValue, int beta = kMateValue);
@@ -236,8 +268,22 @@ class AlphaBetaPlayer {
   void UpdateQuietStats(Stack* ss, const Move& move);
   void UpdateMobilityEvaluation(ThreadState& thread_state, Player turn);
   void UpdateContinuationHistories(Stack* ss, const Move& move, PieceType piece_type, int bonus);
-  bool HasShield(Board& board, PlayerColor color, const BoardLocation& king_loc);
+  // Whether the squares in front of the king are off the board or hold
+  // pieces (only pawns, if `pawns_only`) of its color.
+  bool HasShield(Board& board, PlayerColor color, const BoardLocation& king_loc,
+                 bool pawns_only = false);
+  // The thread's pawn hash entry for the board, computed on a miss.
+  const PawnHashEntry& ProbePawnHash(ThreadState& thread_state, Board& board);
   bool OnBackRank(const BoardLocation& king_loc);
+  // Fills piece_square_table_ for one color: pawn advancement and the
+  // piece-square terms, signed for red-yellow.
+  template <PlayerColor kColor>
+  void InitializePieceSquareTable();
+  // Rook and knight terms of one color's pieces, signed for red-yellow.
+  // Also counts the color's queens.
+  template <PlayerColor kColor>
+  int EvaluatePieces(const Board& board, const PawnHashEntry& pawn_entry,
+                     int& n_queens);
 
   int64_t num_nodes_ = 0; // debugging
   int64_t num_cache_hits_ = 0;
@@ -275,11 +321,13 @@ class AlphaBetaPlayer {
   // For evaluation
   int king_attack_weight_[30];
   int king_attacker_values_[6];
-  // color x piece type x row x col
-  int piece_square_table_[4][6][14][14];
+  // Piece-square and pawn advancement terms, summed by the search boards.
+  PieceSquareTable piece_square_table_;
   // number of moves a piece needs to have to be considered active
   int piece_activation_threshold_[7];
-  bool knight_to_king_[14][14][14][14];
+  // Indexed by PlayerColor: the color's two back ranks, whose squares don't
+  // count towards piece activation.
+  Bitboard back_ranks_[4];
   Team root_team_ = NO_TEAM;
 };
 
@@ -8,6 +8,7 @@
 #include "board.h"
 #include "player.h"
 #include "transposition_table.h"
+#include "utils.h"
 
 namespace chess {
 namespace {
@@ -96,6 +97,89 @@ TEST(Speed, MoveTest) {
 
 }
 
+TEST(Speed, MoveGenerationTest) {
+  std::vector<std::shared_ptr<Board>> boards = {
+    Board::CreateStandardSetup(),
+    ParseBoardFromFEN("Y-0,0,0,0-1,1,1,1-1,1,1,1-0,0,0,0-2-x,x,x,yR,1,yB,yK,1,yB,yN,yR,x,x,x/x,x,x,yP,yP,yP,1,yP,gQ,yP,yP,x,x,x/x,x,x,2,yN,yP,4,x,x,x/bR,bP,1,bN,8,gP,gR/1,bP,10,gP,gN/bB,bP,10,gP,gB/1,bP,9,gP,1,gK/bK,1,bP,9,gP,1/1,bP,bB,9,gP,gB/12,gP,1/bR,bP,2,yQ,5,gN,1,gP,gR/x,x,x,2,rQ,1,rP,3,x,x,x/x,x,x,rP,rP,rP,rP,1,rP,rP,rP,x,x,x/x,x,x,rR,1,rB,1,rK,rB,rN,rR,x,x,x"),
+  };
+
+  constexpr int kIterations = 200000;
+  Move move_buffer[300];
+  int64_t num_moves = 0;
+  int64_t num_attacked = 0;
+
+  auto start = std::chrono::system_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    for (auto& board : boards) {
+      for (int color = 0; color < 4; color++) {
+        Player turn = board->GetTurn();
+        board->SetPlayer(Player(static_cast<PlayerColor>(color)));
+        num_moves += board->GetPseudoLegalMoves2(move_buffer, 300);
+        board->SetPlayer(turn);
+        num_attacked += board->IsKingInCheck(
+            Player(static_cast<PlayerColor>(color)));
+      }
+    }
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now() - start);
+  std::cout << "Duration (ms): " << duration.count() << std::endl;
+  std::cout << "Moves generated: " << num_moves << std::endl;
+  std::cout << "Moves/sec: "
+    << (int64_t)(num_moves / (duration.count() / 1000.0)) << std::endl;
+  EXPECT_GT(num_moves, 0);
+  EXPECT_GE(num_attacked, 0);
+}
+
+TEST(Speed, PositionCopyTest) {
+  auto board = Board::CreateStandardSetup();
+  const Position& position = board->GetPosition();
+
+  // Bytes per stored position: a Position alone, a copied Board, and a
+  // Board whose move and undo stacks are reserved for a search.
+  Board copied(*board);
+  Board reserved(*board);
+  reserved.ReserveMoves();
+  std::cout << "Memory per Position: " << sizeof(Position) << std::endl;
+  std::cout << "Memory per copied Board: " << copied.MemoryUsage()
+    << std::endl;
+  std::cout << "Memory per searchable Board: " << reserved.MemoryUsage()
+    << std::endl;
+
+  constexpr int kPositions = 1000;
+  constexpr int kIterations = 200;
+
+  std::vector<Position> positions(kPositions);
+  auto start = std::chrono::system_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    for (auto& copy : positions) {
+      copy = position;
+    }
+  }
+  auto position_duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now() - start);
+  std::cout << "Position copy (ns): "
+    << position_duration.count() * 1000.0 / (kPositions * kIterations)
+    << std::endl;
+
+  start = std::chrono::system_clock::now();
+  int num_copies = 0;
+  for (int i = 0; i < kIterations; i++) {
+    for (int j = 0; j < kPositions; j++) {
+      Board copy(*board);
+      num_copies += copy.HashKey() == board->HashKey();
+    }
+  }
+  auto board_duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now() - start);
+  std::cout << "Board copy (ns): "
+    << board_duration.count() * 1000.0 / (kPositions * kIterations)
+    << std::endl;
+
+  EXPECT_EQ(positions.back().hash_key_, board->HashKey());
+  EXPECT_EQ(num_copies, kPositions * kIterations);
+}
+
 }  // namespace
 }  // namespace chess
 
@@ -1,30 +1,446 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <optional>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "transposition_table.h"
 
 namespace chess {
 
+namespace {
+
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free);
+
+uint64_t LoadRelaxed(uint64_t& word)
+{
+  return std::atomic_ref<uint64_t>(word).load(std::memory_order_relaxed);
+}
+
+void StoreRelaxed(uint64_t& word, uint64_t value)
+{
+  std::atomic_ref<uint64_t>(word).store(value, std::memory_order_relaxed);
+}
+
+constexpr char kHashTableMagic[8] = "4PCHASH";
+
+// Whether the header of a mapped table was never published: the table was
+// just created, or its creator died while initializing it. Either way no
+// process is using it.
+bool IsUnpublished(const HashTableFileHeader& header)
+{
+  constexpr char kNoMagic[8] = {};
+  return header.version == 0
+    && (std::memcmp(header.magic, kNoMagic, 8) == 0
+        || std::memcmp(header.magic, kHashTableMagic, 8) == 0);
+}
+
+// POSIX shared memory names start with a slash.
+std::string SharedMemoryName(const std::string& name)
+{
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+// Fields of HashTableSlot::data.
+int Depth8(uint64_t data) { return (data >> 16) & 0xFF; }
+uint8_t GenBound8(uint64_t data) { return (data >> 24) & 0xFF; }
+
+// The bits of a slot other than the check, folded to 16.
+uint16_t Fold(uint64_t data, uint64_t values)
+{
+  uint64_t x = (data >> 16) ^ values;
+  x ^= x >> 32;
+  x ^= x >> 16;
+  return static_cast<uint16_t>(x);
+}
+
+// The key check that the slot was written with, if it was written whole.
+uint16_t SlotKey(uint64_t data, uint64_t values)
+{
+  return static_cast<uint16_t>(data) ^ Fold(data, values);
+}
+
+}  // namespace
+
 TranspositionTable::TranspositionTable(
   size_t table_size
 ) {
   assert((table_size > 0) && "transposition table_size = 0");
-  table_size_          = table_size;
-  hash_table_          = (HashTableEntry*) calloc(table_size, sizeof(HashTableEntry));
+  num_clusters_        = std::max<size_t>(table_size / kClusterSize, 1);
+  Allocate();
+  // Also faults the pages in from several threads, instead of during the
+  // first search.
+  Clear();
+}
+
+TranspositionTable::TranspositionTable(
+  size_t table_size,
+  const std::string& path,
+  HashTableBacking backing
+) {
+  assert((table_size > 0) && "transposition table_size = 0");
+  num_clusters_        = std::max<size_t>(table_size / kClusterSize, 1);
+#ifdef __linux__
+  if (backing == HASH_SHARED_MEMORY)
+  {
+    // Initialized like a file: by the first process to lock it, or by the
+    // next one if that process died before publishing the header.
+    int fd = shm_open(SharedMemoryName(path).c_str(), O_RDWR | O_CREAT,
+                      0644);
+    if (fd >= 0)
+    {
+      MapFile(fd);
+      close(fd);
+    }
+  }
+  else
+  {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd >= 0)
+    {
+      MapFile(fd);
+      close(fd);
+    }
+  }
+#endif
+  if (hash_table_ == nullptr)
+  {
+    std::cerr << "Can't map transposition table "
+      << (backing == HASH_SHARED_MEMORY ? "shared memory " : "file ")
+      << path << ", keeping the table in memory." << std::endl;
+    Allocate();
+    Clear();
+  }
+}
+
+void TranspositionTable::Allocate()
+{
+  size_t bytes = num_clusters_ * sizeof(HashTableCluster);
+
+#ifdef __linux__
+  // Whole 2 MB pages: reserved huge pages if there are any, else normal
+  // pages that transparent huge pages may back.
+  constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+  size_t mapped_bytes = (bytes + kHugePageSize - 1) / kHugePageSize
+    * kHugePageSize;
+  void* memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (memory == MAP_FAILED)
+  {
+    memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+      madvise(memory, mapped_bytes, MADV_HUGEPAGE);
+    }
+  }
+  if (memory != MAP_FAILED)
+  {
+    hash_table_   = static_cast<HashTableCluster*>(memory);
+    mapping_      = memory;
+    mapped_bytes_ = mapped_bytes;
+  }
+#endif
+
+  if (hash_table_ == nullptr)
+  {
+    hash_table_ = (HashTableCluster*) std::aligned_alloc(
+        alignof(HashTableCluster), bytes);
+  }
   assert((hash_table_ != nullptr) && "Can't create transposition table. Try using a smaller size.");
 }
 
-const HashTableEntry* TranspositionTable::Get(
+bool TranspositionTable::MapFile(int fd)
+{
+#ifdef __linux__
+  // Processes that open the file at the same time take turns, so that only
+  // one of them initializes it and the others attach to the result.
+  if (flock(fd, LOCK_EX) != 0)
+  {
+    return false;
+  }
+  bool mapped = AttachOrInitialize(fd);
+  flock(fd, LOCK_UN);
+  return mapped;
+#else
+  return false;
+#endif
+}
+
+bool TranspositionTable::AttachOrInitialize(int fd)
+{
+#ifdef __linux__
+  size_t bytes = sizeof(HashTableFileHeader)
+    + num_clusters_ * sizeof(HashTableCluster);
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0)
+  {
+    return false;
+  }
+  // A file of any other size is left alone: it may be some other file, or
+  // a table of another size that other processes are using.
+  size_t file_bytes = static_cast<size_t>(file_stat.st_size);
+  if (file_bytes != 0 && file_bytes != bytes)
+  {
+    return false;
+  }
+  if (file_bytes == 0 && ftruncate(fd, bytes) != 0)
+  {
+    return false;
+  }
+  if (!Map(fd))
+  {
+    return false;
+  }
+  if (IsUnpublished(*file_header_))
+  {
+    Clear();
+    PublishHeader();
+  }
+  else if (!IsCompatible(*file_header_))
+  {
+    Unmap();
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool TranspositionTable::RemoveSharedMemory(const std::string& name)
+{
+#ifdef __linux__
+  return shm_unlink(SharedMemoryName(name).c_str()) == 0;
+#else
+  return false;
+#endif
+}
+
+bool TranspositionTable::Map(int fd)
+{
+#ifdef __linux__
+  size_t bytes = sizeof(HashTableFileHeader)
+    + num_clusters_ * sizeof(HashTableCluster);
+  void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+  if (memory == MAP_FAILED)
+  {
+    return false;
+  }
+  mapping_      = memory;
+  mapped_bytes_ = bytes;
+  file_header_  = static_cast<HashTableFileHeader*>(memory);
+  hash_table_   = reinterpret_cast<HashTableCluster*>(file_header_ + 1);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TranspositionTable::Unmap()
+{
+#ifdef __linux__
+  munmap(mapping_, mapped_bytes_);
+#endif
+  mapping_      = nullptr;
+  mapped_bytes_ = 0;
+  file_header_  = nullptr;
+  hash_table_   = nullptr;
+}
+
+void TranspositionTable::PublishHeader()
+{
+  HashTableFileHeader header = CreateHeader();
+  uint32_t version = header.version;
+  header.version   = 0;
+  *file_header_ = header;
+  std::atomic_ref<uint32_t>(file_header_->version)
+    .store(version, std::memory_order_release);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+  if (hash_table_ == nullptr)
+  {
+    return;
+  }
+#ifdef __linux__
+  if (mapping_ != nullptr)
+  {
+    munmap(mapping_, mapped_bytes_);
+    return;
+  }
+#endif
+  free(hash_table_);
+}
+
+HashTableFileHeader TranspositionTable::CreateHeader() const
+{
+  HashTableFileHeader header = {};
+  std::memcpy(header.magic, kHashTableMagic, 8);
+  header.version       = kHashTableFormatVersion;
+  header.cluster_bytes = sizeof(HashTableCluster);
+  header.zobrist_seed  = kZobristSeed;
+  header.num_clusters  = num_clusters_;
+  header.generation8   = Generation8();
+  return header;
+}
+
+bool TranspositionTable::IsCompatible(
+  const HashTableFileHeader& header
+) const {
+  HashTableFileHeader expected = CreateHeader();
+  return std::memcmp(header.magic, expected.magic, 8) == 0
+    && header.version == expected.version
+    && header.cluster_bytes == expected.cluster_bytes
+    && header.zobrist_seed == expected.zobrist_seed
+    && header.num_clusters == expected.num_clusters;
+}
+
+bool TranspositionTable::SaveToFile(
+  const std::string& path
+) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  HashTableFileHeader header = CreateHeader();
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  // Other threads or processes may be writing the table: copy it out in
+  // batches, with the same relaxed loads as Get. A slot written meanwhile
+  // may hold words of two writes, which fails its key check on loading.
+  constexpr size_t kBatchClusters = 4096;
+  std::vector<HashTableCluster> batch(
+      std::min(kBatchClusters, num_clusters_));
+  for (size_t start = 0; start < num_clusters_; start += batch.size())
+  {
+    size_t count = std::min(batch.size(), num_clusters_ - start);
+    for (size_t c = 0; c < count; c++)
+    {
+      for (int i = 0; i < kClusterSize; i++)
+      {
+        HashTableSlot& slot = hash_table_[start + c].slot[i];
+        batch[c].slot[i].data   = LoadRelaxed(slot.data);
+        batch[c].slot[i].values = LoadRelaxed(slot.values);
+      }
+    }
+    file.write(reinterpret_cast<const char*>(batch.data()),
+               count * sizeof(HashTableCluster));
+  }
+  return file.good();
+}
+
+bool TranspositionTable::LoadFromFile(
+  const std::string& path
+) {
+  // Other processes may be searching on a mapped table.
+  if (IsMapped())
+  {
+    return false;
+  }
+  std::ifstream file(path, std::ios::binary);
+  HashTableFileHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+      || !IsCompatible(header))
+  {
+    return false;
+  }
+  // Check the length first, so that a short file leaves the table intact.
+  size_t bytes = num_clusters_ * sizeof(HashTableCluster);
+  file.seekg(0, std::ios::end);
+  if (static_cast<size_t>(file.tellg()) != sizeof(header) + bytes)
+  {
+    return false;
+  }
+  file.seekg(sizeof(header));
+  if (!file.read(reinterpret_cast<char*>(hash_table_), bytes))
+  {
+    Clear();
+    return false;
+  }
+  SetGeneration8(header.generation8);
+  return true;
+}
+
+void TranspositionTable::NewSearch()
+{
+  if (file_header_ != nullptr)
+  {
+    std::atomic_ref<uint8_t>(file_header_->generation8)
+      .fetch_add(kGenerationDelta, std::memory_order_relaxed);
+  }
+  else
+  {
+    generation8_ += kGenerationDelta;
+  }
+}
+
+void TranspositionTable::SetGeneration8(uint8_t generation8)
+{
+  if (file_header_ != nullptr)
+  {
+    std::atomic_ref<uint8_t>(file_header_->generation8)
+      .store(generation8, std::memory_order_relaxed);
+  }
+  else
+  {
+    generation8_ = generation8;
+  }
+}
+
+void TranspositionTable::Clear()
+{
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk = (num_clusters_ + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  for (size_t start = 0; start < num_clusters_; start += chunk)
+  {
+    size_t count = std::min(chunk, num_clusters_ - start);
+    threads.emplace_back([this, start, count]() {
+      std::memset(static_cast<void*>(hash_table_ + start), 0,
+                  count * sizeof(HashTableCluster));
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  SetGeneration8(0);
+}
+
+std::optional<HashTableEntry> TranspositionTable::Get(
   int64_t key
 ) {
-  size_t n = key % table_size_;
-  HashTableEntry* entry = hash_table_ + n;
-  if (entry->key == key)
+  uint16_t key16 = KeyCheck(key);
+  HashTableCluster& cluster = GetCluster(key);
+  for (int i = 0; i < kClusterSize; i++)
   {
-    return entry;
+    uint64_t data   = LoadRelaxed(cluster.slot[i].data);
+    uint64_t values = LoadRelaxed(cluster.slot[i].values);
+    if (Depth8(data) != 0 && SlotKey(data, values) == key16)
+    {
+      HashTableEntry entry;
+      entry.depth = Depth8(data) + kTTDepthOffset;
+      entry.move  = PackedMove::FromBits(static_cast<uint32_t>(data >> 32));
+      entry.score = static_cast<int32_t>(values);
+      entry.eval  = static_cast<int32_t>(values >> 32);
+      entry.bound = static_cast<ScoreBound>(GenBound8(data) & 0x3);
+      entry.is_pv = GenBound8(data) & 0x4;
+      return entry;
+    }
   }
-  return nullptr;
+  return std::nullopt;
 }
 
 void TranspositionTable::Save(
@@ -36,18 +452,69 @@ void TranspositionTable::Save(
   ScoreBound bound,
   bool is_pv
 ) {
-  size_t n = key % table_size_;
-  HashTableEntry& entry = hash_table_[n];
-  if (bound == EXACT || entry.key != key || entry.depth < depth)
+  uint16_t key16 = KeyCheck(key);
+  HashTableCluster& cluster = GetCluster(key);
+  uint8_t generation8 = Generation8();
+
+  // Work on copies: other threads may write the cluster meanwhile, in which
+  // case the last writer of a slot wins.
+  uint64_t data[kClusterSize];
+  uint64_t values[kClusterSize];
+  for (int i = 0; i < kClusterSize; i++)
+  {
+    data[i]   = LoadRelaxed(cluster.slot[i].data);
+    values[i] = LoadRelaxed(cluster.slot[i].values);
+  }
+
+  int replace = -1;
+  for (int i = 0; i < kClusterSize; i++)
+  {
+    if (Depth8(data[i]) == 0 || SlotKey(data[i], values[i]) == key16)
+    {
+      replace = i;
+      break;
+    }
+  }
+  if (replace < 0)
   {
-    entry.key   = key;
-    entry.depth = depth;
-    entry.move  = move;
-    entry.score = score;
-    entry.eval  = eval;
-    entry.bound = bound;
-    entry.is_pv = is_pv;
+    replace = 0;
+    for (int i = 1; i < kClusterSize; i++)
+    {
+      if (Depth8(data[i]) - RelativeAge(GenBound8(data[i]), generation8)
+          < Depth8(data[replace])
+            - RelativeAge(GenBound8(data[replace]), generation8))
+      {
+        replace = i;
+      }
+    }
   }
+
+  uint64_t old_data = data[replace];
+  bool same_key = Depth8(old_data) != 0
+    && SlotKey(old_data, values[replace]) == key16;
+
+  // Keep the move of an entry that is only refreshed without one.
+  uint32_t move_bits = move.has_value() ? PackedMove(*move).Bits() : 0;
+  if (!move.has_value() && same_key)
+  {
+    move_bits = static_cast<uint32_t>(old_data >> 32);
+  }
+  uint64_t new_data   = old_data & 0xFFFF'FFFF;
+  uint64_t new_values = values[replace];
+  if (bound == EXACT || !same_key
+      || Depth8(old_data) + kTTDepthOffset < depth
+      || RelativeAge(GenBound8(old_data), generation8) != 0)
+  {
+    uint64_t depth8    = std::clamp(depth - kTTDepthOffset, 1, 255);
+    uint64_t genbound8 = generation8 | (is_pv << 2) | bound;
+    new_data   = (depth8 << 16) | (genbound8 << 24);
+    new_values = static_cast<uint32_t>(score)
+      | static_cast<uint64_t>(static_cast<uint32_t>(eval)) << 32;
+  }
+  new_data = (new_data & ~0xFFFFull) | (static_cast<uint64_t>(move_bits) << 32);
+  new_data |= key16 ^ Fold(new_data, new_values);
+
+  StoreRelaxed(cluster.slot[replace].data, new_data);
+  StoreRelaxed(cluster.slot[replace].values, new_values);
 }
 }  // namespace chess
-
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <cstdint>
 #include <optional>
+#include <string>
 
 #include "board.h"
 
@@ -16,23 +17,99 @@ enum ScoreBound
   EXACT = 0, LOWER_BOUND = 1, UPPER_BOUND = 2,
 };
 
+// Depths are stored as depth - kTTDepthOffset in a byte, so that depth8 == 0
+// can mark an empty slot.
+constexpr int kTTDepthOffset = -8;
+
+// A result stored for a position, as copied out of the table by Get.
 struct HashTableEntry
 {
-  int64_t key;
   int depth;
-  std::optional<Move> move;
+  PackedMove move;
   int score;
   int eval;
   ScoreBound bound;
   bool is_pv;
 };
 
+// One slot of a cluster, in two 64-bit words:
+//   data:   check (16 bits) | depth8 (8) | genbound8 (8) | move (32)
+//   values: score (32) | eval (32)
+// genbound8 is generation (5 bits) | pv (1 bit) | bound (2 bits). check is
+// the low 16 bits of the key XOR the other 112 bits folded to 16, so a slot
+// that is read while another thread writes it (one word old, one new) fails
+// the key check instead of mixing two results. Each word is read and
+// written with a relaxed atomic access; there are no locks.
+struct HashTableSlot
+{
+  uint64_t data;
+  uint64_t values;
+};
+static_assert(sizeof(HashTableSlot) == 16);
+
+// Slots whose keys map to the same index, sharing one cache line.
+constexpr int kClusterSize = 4;
+
+struct alignas(64) HashTableCluster
+{
+  HashTableSlot slot[kClusterSize];
+};
+static_assert(sizeof(HashTableCluster) == 64);
+
+// Bumped whenever the layout of HashTableSlot or of the file changes.
+constexpr uint32_t kHashTableFormatVersion = 1;
+
+// First 64 bytes of a table file (see TranspositionTable::SaveToFile and
+// the file-backed constructor), followed by the clusters. A file is only
+// used if it matches the slot format, the Zobrist keys and the table size.
+struct alignas(64) HashTableFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t cluster_bytes;
+  uint64_t zobrist_seed;
+  uint64_t num_clusters;
+  uint8_t  generation8;
+};
+static_assert(sizeof(HashTableFileHeader) == 64);
+
+// Where a mapped table lives: a file, or a named POSIX shared memory
+// segment (in /dev/shm, until RemoveSharedMemory) that several engine processes can
+// map at once. Processes access it with the same lockless slot validation
+// as threads.
+enum HashTableBacking
+{
+  HASH_FILE = 0, HASH_SHARED_MEMORY = 1,
+};
+
+// Shared by all search threads.
 class TranspositionTable
 {
 public:
+  // table_size is the number of entries, rounded down to whole clusters.
+  // The table is mapped on huge pages where the system provides them.
   TranspositionTable(size_t table_size);
+  // A table that lives in the file or shared memory segment at path,
+  // mapped into memory, so that it outlasts the process. A new or empty
+  // file is initialized; any other file is used only if it holds a
+  // matching table, and is never resized or reset. A shared memory segment
+  // is treated the same way. Falls back to a table in memory if the path
+  // can not be mapped.
+  TranspositionTable(size_t table_size, const std::string& path,
+                     HashTableBacking backing = HASH_FILE);
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
 
-  const HashTableEntry* Get(int64_t key);
+  std::optional<HashTableEntry> Get(int64_t key);
+  // Starts loading the cluster of the key into the cache, so that a Get or
+  // Save shortly after does not wait for memory.
+  void Prefetch(int64_t key)
+  {
+    __builtin_prefetch(&GetCluster(key));
+  }
+  // Stores the result in the slot of the cluster that holds the key, else
+  // in an empty slot, else in the slot whose entry is worth least (shallow
+  // or from an old search).
   void Save(
     int64_t key,
     int depth,
@@ -43,17 +120,96 @@ public:
     bool is_pv
   );
 
-  ~TranspositionTable()
+  // Starts a new generation: entries of earlier searches become the first
+  // to be replaced, and are overwritten by any new result for their key.
+  // The generation of a mapped table is shared by all processes that map
+  // it.
+  void NewSearch();
+  // Empties the table, zeroing it from several threads.
+  void Clear();
+  // Removes the name of a shared memory segment, e.g. one that holds a
+  // table of another size. Processes that map it keep their mapping; the
+  // next table to open the name creates a new segment.
+  static bool RemoveSharedMemory(const std::string& name);
+  // Whether the table lives in a file or shared memory segment, which
+  // other processes may be using.
+  bool IsMapped() const
   {
-    if (hash_table_ != nullptr)
-    {
-      free(hash_table_);
-    }
+    return file_header_ != nullptr;
   }
 
+  // Writes a snapshot of the table to the file, or reads one back. Loading
+  // fails, leaving the table as it was, unless the file was saved by a
+  // table of the same size and format (and is empty after a read error).
+  // A mapped table, which other processes may be using, is never loaded
+  // into. Not to be called during a search.
+  bool SaveToFile(const std::string& path) const;
+  bool LoadFromFile(const std::string& path);
+
+  ~TranspositionTable();
+
 private:
-  HashTableEntry* hash_table_ = nullptr;
-  size_t table_size_          = 0;
+  // Generations advance in steps of 8, above the pv and bound bits, and
+  // wrap around after 32 searches.
+  static constexpr int kGenerationDelta = 1 << 3;
+  static constexpr int kGenerationCycle = 255 + kGenerationDelta;
+  static constexpr int kGenerationMask  = 0xF8;
+
+  // The cluster comes from the high bits of the key (a multiply-shift
+  // instead of a 64-bit modulo, for any number of clusters) and the check
+  // from the low bits.
+  static uint16_t KeyCheck(int64_t key)
+  {
+    return static_cast<uint16_t>(key);
+  }
+  HashTableCluster& GetCluster(int64_t key)
+  {
+    return hash_table_[static_cast<size_t>(
+        (static_cast<unsigned __int128>(static_cast<uint64_t>(key))
+         * num_clusters_) >> 64)];
+  }
+  void Allocate();
+  // Maps the table from the open file or shared memory segment under an
+  // exclusive flock, see AttachOrInitialize.
+  bool MapFile(int fd);
+  // Initializes the file if it is empty or was never published, else maps
+  // it if it holds a matching table.
+  bool AttachOrInitialize(int fd);
+  bool Map(int fd);
+  void Unmap();
+  HashTableFileHeader CreateHeader() const;
+  bool IsCompatible(const HashTableFileHeader& header) const;
+  // Writes the header of a mapped table, its version last, so that other
+  // processes only see it once the table is ready.
+  void PublishHeader();
+
+  // The generation of the current search, read from the header of a
+  // mapped table, where other processes may advance it.
+  uint8_t Generation8() const
+  {
+    return file_header_ != nullptr
+      ? std::atomic_ref<uint8_t>(file_header_->generation8)
+          .load(std::memory_order_relaxed)
+      : generation8_;
+  }
+  void SetGeneration8(uint8_t generation8);
+
+  // Number of generations since genbound8 was written, times 8.
+  static int RelativeAge(uint8_t genbound8, uint8_t generation8)
+  {
+    return (kGenerationCycle + generation8 - genbound8) & kGenerationMask;
+  }
+
+  HashTableCluster* hash_table_ = nullptr;
+  size_t num_clusters_          = 0;
+  // Start and length of the mapping that holds the table, or nullptr if it
+  // was allocated on the heap.
+  void* mapping_                = nullptr;
+  size_t mapped_bytes_          = 0;
+  // Header at the start of the mapping of a file-backed table.
+  HashTableFileHeader* file_header_ = nullptr;
+  // The generation of a table in memory.
+  uint8_t generation8_          = 0;
 };
 
 }  // namespace chess
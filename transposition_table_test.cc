@@ -0,0 +1,309 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "transposition_table.h"
+
+namespace chess {
+namespace {
+
+// Keys with distinct low bits, so that their stored key checks differ, and
+// high bits that spread them over the clusters.
+int64_t TestKey(int i) {
+  return static_cast<int64_t>((static_cast<uint64_t>(i) << 58) | i);
+}
+
+TEST(TranspositionTableTest, SaveAndGet) {
+  TranspositionTable table(1024);
+  EXPECT_FALSE(table.Get(TestKey(1)).has_value());
+
+  Move move(BoardLocation(12, 4), BoardLocation(10, 4));
+  table.Save(TestKey(1), 5, move, 42, 17, LOWER_BOUND, true);
+  std::optional<HashTableEntry> entry = table.Get(TestKey(1));
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->depth, 5);
+  EXPECT_EQ(entry->move, PackedMove(move));
+  EXPECT_EQ(entry->score, 42);
+  EXPECT_EQ(entry->eval, 17);
+  EXPECT_EQ(entry->bound, LOWER_BOUND);
+  EXPECT_TRUE(entry->is_pv);
+
+  // A shallower result for the same key does not replace a bound, but a
+  // result without a move keeps the stored move.
+  table.Save(TestKey(1), 3, std::nullopt, 7, 17, UPPER_BOUND, false);
+  entry = table.Get(TestKey(1));
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->depth, 5);
+  EXPECT_EQ(entry->score, 42);
+  EXPECT_EQ(entry->move, PackedMove(move));
+
+  // QSearch stores depth 0.
+  table.Save(TestKey(2), 0, std::nullopt, 1, 2, EXACT, false);
+  entry = table.Get(TestKey(2));
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->depth, 0);
+  EXPECT_FALSE(entry->move.Present());
+}
+
+TEST(TranspositionTableTest, ReplacesShallowestEntryOfCluster) {
+  // A single cluster, so that all keys collide.
+  TranspositionTable table(kClusterSize);
+  for (int i = 0; i < kClusterSize; i++) {
+    table.Save(TestKey(i + 1), 10 + i, std::nullopt, i, i, EXACT, false);
+  }
+  for (int i = 0; i < kClusterSize; i++) {
+    EXPECT_TRUE(table.Get(TestKey(i + 1)).has_value());
+  }
+
+  table.Save(TestKey(100), 1, std::nullopt, 0, 0, EXACT, false);
+  EXPECT_TRUE(table.Get(TestKey(100)).has_value());
+  EXPECT_FALSE(table.Get(TestKey(1)).has_value());
+  for (int i = 1; i < kClusterSize; i++) {
+    EXPECT_TRUE(table.Get(TestKey(i + 1)).has_value());
+  }
+}
+
+TEST(TranspositionTableTest, OldGenerationsGiveWay) {
+  TranspositionTable table(kClusterSize);
+  table.Save(TestKey(1), 12, std::nullopt, 1, 1, LOWER_BOUND, false);
+  table.Save(TestKey(2), 12, std::nullopt, 2, 2, LOWER_BOUND, false);
+  table.NewSearch();
+  table.Save(TestKey(3), 5, std::nullopt, 3, 3, LOWER_BOUND, false);
+  table.Save(TestKey(4), 5, std::nullopt, 4, 4, LOWER_BOUND, false);
+
+  // The deeper entries of the last search are worth less than current ones.
+  table.Save(TestKey(5), 5, std::nullopt, 5, 5, LOWER_BOUND, false);
+  EXPECT_FALSE(table.Get(TestKey(1)).has_value());
+  EXPECT_TRUE(table.Get(TestKey(3)).has_value());
+  EXPECT_TRUE(table.Get(TestKey(5)).has_value());
+
+  // A shallower result replaces an old entry for the same key.
+  table.Save(TestKey(2), 3, std::nullopt, 20, 20, LOWER_BOUND, false);
+  auto entry = table.Get(TestKey(2));
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->depth, 3);
+  EXPECT_EQ(entry->score, 20);
+
+  table.Clear();
+  for (int i = 1; i <= 5; i++) {
+    EXPECT_FALSE(table.Get(TestKey(i)).has_value());
+  }
+}
+
+TEST(TranspositionTableTest, SaveToFileAndLoadFromFile) {
+  std::string path = testing::TempDir() + "tt_snapshot.bin";
+  TranspositionTable table(1024);
+  table.Save(TestKey(1), 7, std::nullopt, 11, 12, EXACT, true);
+  ASSERT_TRUE(table.SaveToFile(path));
+
+  TranspositionTable loaded(1024);
+  ASSERT_TRUE(loaded.LoadFromFile(path));
+  auto entry = loaded.Get(TestKey(1));
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->depth, 7);
+  EXPECT_EQ(entry->score, 11);
+
+  // A table of another size can not use the snapshot, and is left alone.
+  TranspositionTable other(2048);
+  other.Save(TestKey(2), 3, std::nullopt, 1, 1, EXACT, false);
+  EXPECT_FALSE(other.LoadFromFile(path));
+  EXPECT_TRUE(other.Get(TestKey(2)).has_value());
+  EXPECT_FALSE(other.LoadFromFile(path + ".missing"));
+  std::remove(path.c_str());
+}
+
+TEST(TranspositionTableTest, FileBackedTableOutlivesTheTable) {
+  std::string path = testing::TempDir() + "tt_mapped.bin";
+  std::remove(path.c_str());
+  {
+    TranspositionTable table(1024, path);
+    table.Save(TestKey(1), 9, std::nullopt, 21, 22, LOWER_BOUND, false);
+  }
+  {
+    TranspositionTable table(1024, path);
+    auto entry = table.Get(TestKey(1));
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->depth, 9);
+    EXPECT_EQ(entry->score, 21);
+
+    // Other processes may be using the mapped table: a snapshot is not
+    // loaded over it.
+    std::string snapshot = testing::TempDir() + "tt_mapped_snapshot.bin";
+    TranspositionTable empty(1024);
+    ASSERT_TRUE(empty.SaveToFile(snapshot));
+    EXPECT_FALSE(table.LoadFromFile(snapshot));
+    EXPECT_TRUE(table.Get(TestKey(1)).has_value());
+    std::remove(snapshot.c_str());
+  }
+  {
+    // Another size keeps its table in memory and leaves the file alone.
+    TranspositionTable table(4096, path);
+    EXPECT_FALSE(table.IsMapped());
+    EXPECT_FALSE(table.Get(TestKey(1)).has_value());
+  }
+  {
+    TranspositionTable table(1024, path);
+    EXPECT_TRUE(table.IsMapped());
+    EXPECT_TRUE(table.Get(TestKey(1)).has_value());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TranspositionTableTest, FileBackedTableLeavesOtherFilesAlone) {
+  std::string path = testing::TempDir() + "tt_not_a_table.txt";
+  {
+    std::ofstream file(path);
+    file << "not a transposition table";
+  }
+  {
+    TranspositionTable table(1024, path);
+    EXPECT_FALSE(table.IsMapped());
+  }
+  std::ifstream file(path);
+  std::string contents;
+  std::getline(file, contents);
+  EXPECT_EQ(contents, "not a transposition table");
+  std::remove(path.c_str());
+
+  // A file of the right size whose header was never published, as left by
+  // a process that died while initializing it, is initialized.
+  size_t bytes = sizeof(HashTableFileHeader)
+    + 1024 / kClusterSize * sizeof(HashTableCluster);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, bytes), 0);
+  close(fd);
+  {
+    TranspositionTable table(1024, path);
+    EXPECT_TRUE(table.IsMapped());
+    table.Save(TestKey(1), 4, std::nullopt, 5, 6, EXACT, false);
+  }
+  {
+    TranspositionTable table(1024, path);
+    EXPECT_TRUE(table.IsMapped());
+    EXPECT_TRUE(table.Get(TestKey(1)).has_value());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TranspositionTableTest, SharedMemoryTableIsSharedBetweenTables) {
+  // Two tables mapping one segment, as two engine processes would.
+  std::string name = "/4pchess_tt_test_" + std::to_string(getpid());
+  {
+    TranspositionTable first(1024, name, HASH_SHARED_MEMORY);
+    TranspositionTable second(1024, name, HASH_SHARED_MEMORY);
+    first.Save(TestKey(1), 6, std::nullopt, 31, 32, EXACT, false);
+    auto entry = second.Get(TestKey(1));
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->depth, 6);
+    EXPECT_EQ(entry->score, 31);
+
+    // Generations advance together.
+    first.NewSearch();
+    second.NewSearch();
+    second.Save(TestKey(2), 6, std::nullopt, 41, 42, EXACT, false);
+    EXPECT_TRUE(first.Get(TestKey(2)).has_value());
+
+    // The generation that a process writes is the one that the others
+    // advanced to: a current entry is not taken for an old one.
+    second.NewSearch();
+    second.Save(TestKey(3), 9, std::nullopt, 1, 1, LOWER_BOUND, false);
+    first.Save(TestKey(3), 3, std::nullopt, 2, 2, LOWER_BOUND, false);
+    entry = second.Get(TestKey(3));
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->depth, 9);
+
+    // A table of another size does not take over the segment.
+    TranspositionTable other(4096, name, HASH_SHARED_MEMORY);
+    EXPECT_FALSE(other.Get(TestKey(1)).has_value());
+    EXPECT_TRUE(second.Get(TestKey(1)).has_value());
+
+    // Nor does a table of another format.
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    void* memory = mmap(nullptr, sizeof(HashTableFileHeader),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(memory, MAP_FAILED);
+    auto* header = static_cast<HashTableFileHeader*>(memory);
+    header->version = kHashTableFormatVersion + 1;
+    TranspositionTable newer(1024, name, HASH_SHARED_MEMORY);
+    EXPECT_FALSE(newer.Get(TestKey(1)).has_value());
+    EXPECT_TRUE(first.Get(TestKey(1)).has_value());
+    EXPECT_EQ(header->version, kHashTableFormatVersion + 1);
+    munmap(memory, sizeof(HashTableFileHeader));
+  }
+  EXPECT_TRUE(TranspositionTable::RemoveSharedMemory(name));
+}
+
+TEST(TranspositionTableTest, SharedMemoryLeftByADeadCreatorIsRecovered) {
+  std::string name = "/4pchess_tt_stale_" + std::to_string(getpid());
+  // Segments whose creator died before publishing the header: one never
+  // sized, one sized but not initialized.
+  size_t bytes = sizeof(HashTableFileHeader)
+    + 1024 / kClusterSize * sizeof(HashTableCluster);
+  for (size_t stale_bytes : {size_t{0}, bytes}) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, stale_bytes), 0);
+    close(fd);
+    {
+      TranspositionTable table(1024, name, HASH_SHARED_MEMORY);
+      EXPECT_TRUE(table.IsMapped());
+      table.Save(TestKey(1), 4, std::nullopt, 5, 6, EXACT, false);
+      TranspositionTable other(1024, name, HASH_SHARED_MEMORY);
+      EXPECT_TRUE(other.Get(TestKey(1)).has_value());
+    }
+    EXPECT_TRUE(TranspositionTable::RemoveSharedMemory(name));
+    EXPECT_LT(shm_open(name.c_str(), O_RDWR, 0), 0);
+  }
+  EXPECT_FALSE(TranspositionTable::RemoveSharedMemory(name));
+}
+
+TEST(TranspositionTableTest, ConcurrentAccessNeverMixesEntries) {
+  // Few clusters, so that threads keep overwriting each other's slots.
+  TranspositionTable table(2 * kClusterSize);
+  constexpr int kThreads = 4;
+  constexpr int kKeys = 64;
+  constexpr int kIterations = 100000;
+
+  std::vector<std::unique_ptr<std::thread>> threads;
+  std::vector<int> num_mixed(kThreads, 0);
+  for (int t = 0; t < kThreads; t++) {
+    threads.push_back(std::make_unique<std::thread>([&table, &num_mixed, t] {
+      for (int i = 0; i < kIterations; i++) {
+        int k = (i * 7 + t) % kKeys;
+        if ((i + t) % 2 == 0) {
+          table.Save(TestKey(k + 1), k % 16, std::nullopt, 1000 * k, -k,
+                     EXACT, false);
+        } else {
+          auto entry = table.Get(TestKey(k + 1));
+          if (entry.has_value()
+              && (entry->score != 1000 * k || entry->eval != -k
+                  || entry->depth != k % 16)) {
+            num_mixed[t]++;
+          }
+        }
+      }
+    }));
+  }
+  for (const auto& thread : threads) {
+    thread->join();
+  }
+  for (int t = 0; t < kThreads; t++) {
+    EXPECT_EQ(num_mixed[t], 0);
+  }
+}
+
+}  // namespace
+}  // namespace chess
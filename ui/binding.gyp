@@ -5,6 +5,7 @@
       "sources": [
         "cpp/addon.cc",
         "cpp/board_wrapper.cc",
+        "../bitboard.cc",
         "../board.cc",
         "../player.cc",
         "../transposition_table.cc",